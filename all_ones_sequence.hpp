@@ -69,6 +69,15 @@ namespace quasi_succinct {
                 return m_position - 1;
             }
 
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+                for (uint64_t i = 0; i < count; ++i) {
+                    out[i] = uint32_t(position + i);
+                }
+                m_position = position + count - 1;
+            }
+
         private:
             uint64_t m_universe;
             uint64_t m_position;
@@ -0,0 +1,278 @@
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <succinct/mapper.hpp>
+
+#include "benchmark.hpp"
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "loaded_index.hpp"
+#include "queries.hpp"
+#include "util.hpp"
+#include "wand_data.hpp"
+
+// Benchmarks every index type and every query operator and writes the
+// results as JSON. Each query is timed with the TSC into a latency
+// histogram, and the hardware counters are sampled around the timed runs.
+// "compare" flags the regressions between two result files.
+
+struct bench_result {
+    std::string type;
+    std::string query;
+    size_t runs;
+    quasi_succinct::latency_histogram latencies;
+    bool has_counter[quasi_succinct::perf_counters::num_events];
+    double counters[quasi_succinct::perf_counters::num_events]; // per query
+};
+
+template <typename IndexType>
+struct query_benchmark {
+    IndexType const& index;
+    std::vector<quasi_succinct::term_id_vec> const& queries;
+    std::string const& type;
+    std::vector<bench_result>& results;
+
+    template <typename QueryOperatorFactory>
+    void operator()(std::string const& query_type,
+                    QueryOperatorFactory make_query_op, size_t runs) const
+    {
+        using namespace quasi_succinct;
+
+        if (configuration::get().bench_runs) {
+            runs = configuration::get().bench_runs;
+        }
+        auto query_op = make_query_op();
+        results.emplace_back();
+        bench_result& result = results.back();
+        result.type = type;
+        result.query = query_type;
+        result.runs = runs;
+
+        // the first run is not timed
+        for (auto const& query: queries) {
+            uint64_t r = query_op(index, query);
+            do_not_optimize_away(r);
+        }
+
+        perf_counters counters;
+        counters.start();
+        for (size_t run = 0; run < runs; ++run) {
+            for (auto const& query: queries) {
+                uint64_t tick = tsc_clock::now();
+                uint64_t r = query_op(index, query);
+                do_not_optimize_away(r);
+                uint64_t ticks = tsc_clock::now() - tick;
+                result.latencies.record(uint64_t(tsc_clock::nsecs(ticks)));
+            }
+        }
+        counters.stop();
+
+        uint64_t timed = std::max<uint64_t>(1, result.latencies.count());
+        for (size_t e = 0; e < perf_counters::num_events; ++e) {
+            auto ev = perf_counters::event(e);
+            result.has_counter[e] = counters.available(ev);
+            result.counters[e] = double(counters.value(ev)) / timed;
+        }
+
+        auto const& h = result.latencies;
+        logger() << type << " " << query_type << ": mean " << h.mean()
+                 << " ns, p50 " << h.quantile(0.5)
+                 << " ns, p99 " << h.quantile(0.99)
+                 << " ns, max " << h.max() << " ns" << std::endl;
+    }
+};
+
+template <typename IndexType>
+void bench_index(const char* index_filename,
+                 quasi_succinct::wand_data<> const* wdata,
+                 std::vector<quasi_succinct::term_id_vec> const& queries,
+                 std::string const& type,
+                 std::vector<bench_result>& results)
+{
+    using namespace quasi_succinct;
+
+    auto const& conf = configuration::get();
+    logger() << "Loading " << type << " index from " << index_filename << std::endl;
+    loaded_index<IndexType> index(index_filename, conf.load_mode, conf.numa_mode,
+                                  conf.warmup_threads);
+    query_benchmark<loaded_index<IndexType>> bench = {index, queries, type, results};
+    for_each_query_type(wdata, conf.query_shards, bench);
+}
+
+void write_results(std::ostream& os, std::vector<bench_result> const& results,
+                   size_t num_queries)
+{
+    using namespace quasi_succinct;
+
+    os << "{\n"
+       << "  \"queries\": " << num_queries << ",\n"
+       << "  \"nsecs_per_tick\": " << tsc_clock::nsecs_per_tick() << ",\n"
+       << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto const& r = results[i];
+        auto const& h = r.latencies;
+        os << (i ? "," : "") << "\n    {"
+           << "\"type\": \"" << r.type << "\", "
+           << "\"query\": \"" << r.query << "\", "
+           << "\"runs\": " << r.runs << ", "
+           << "\"count\": " << h.count() << ",\n     "
+           << "\"mean_ns\": " << h.mean() << ", "
+           << "\"min_ns\": " << h.min() << ", "
+           << "\"p50_ns\": " << h.quantile(0.5) << ", "
+           << "\"p90_ns\": " << h.quantile(0.9) << ", "
+           << "\"p99_ns\": " << h.quantile(0.99) << ", "
+           << "\"p999_ns\": " << h.quantile(0.999) << ", "
+           << "\"max_ns\": " << h.max() << ",\n     "
+           << "\"counters\": {";
+        bool first = true;
+        for (size_t e = 0; e < perf_counters::num_events; ++e) {
+            if (!r.has_counter[e]) continue;
+            os << (first ? "" : ", ") << "\""
+               << perf_counters::name(perf_counters::event(e)) << "\": "
+               << r.counters[e];
+            first = false;
+        }
+        os << "},\n     \"histogram\": [";
+        first = true;
+        h.for_each_bucket([&](uint64_t value, uint64_t count) {
+                os << (first ? "" : ", ") << "[" << value << ", " << count << "]";
+                first = false;
+            });
+        os << "]}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+int run(int argc, const char** argv)
+{
+    using namespace quasi_succinct;
+
+    std::string prefix = argv[2];
+    const char* wand_data_filename = std::string(argv[3]) == "-" ? nullptr : argv[3];
+    const char* output_filename = argv[4];
+    std::vector<std::string> types(argv + 5, argv + argc);
+
+    std::vector<term_id_vec> queries;
+    term_id_vec q;
+    while (read_query(q)) queries.push_back(q);
+
+    wand_data<> wdata;
+    boost::iostreams::mapped_file_source md;
+    if (wand_data_filename) {
+        md.open(wand_data_filename);
+        succinct::mapper::map(wdata, md, succinct::mapper::map_flags::warmup);
+    }
+    wand_data<> const* wdata_ptr = wand_data_filename ? &wdata : nullptr;
+
+    logger() << "TSC at " << 1 / tsc_clock::nsecs_per_tick() << " GHz" << std::endl;
+
+    std::vector<bench_result> results;
+    auto selected = [&](std::string const& type) {
+        return types.empty()
+            || std::find(types.begin(), types.end(), type) != types.end();
+    };
+
+#define LOOP_BODY(R, DATA, T)                                           \
+    {                                                                   \
+        std::string type = BOOST_PP_STRINGIZE(T);                       \
+        std::string filename = prefix + "." + type;                     \
+        if (!selected(type)) {                                          \
+        } else if (!std::ifstream(filename).good()) {                   \
+            logger() << "Skipping " << type << ": "                     \
+                     << filename << " not found" << std::endl;          \
+        } else {                                                        \
+            bench_index<BOOST_PP_CAT(T, _index)>                        \
+                (filename.c_str(), wdata_ptr, queries, type, results);  \
+        }                                                               \
+    }                                                                   \
+    /**/
+
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+
+    std::ofstream os(output_filename);
+    write_results(os, results, queries.size());
+    logger() << "Wrote " << results.size() << " results to "
+             << output_filename << std::endl;
+    return 0;
+}
+
+typedef std::map<std::pair<std::string, std::string>,
+                 boost::property_tree::ptree> result_map;
+
+result_map read_results(const char* filename)
+{
+    boost::property_tree::ptree root;
+    boost::property_tree::read_json(filename, root);
+    result_map results;
+    for (auto const& child: root.get_child("results")) {
+        auto const& r = child.second;
+        results[std::make_pair(r.get<std::string>("type"),
+                               r.get<std::string>("query"))] = r;
+    }
+    return results;
+}
+
+int compare(int argc, const char** argv)
+{
+    using namespace quasi_succinct;
+
+    result_map baseline = read_results(argv[2]);
+    result_map current = read_results(argv[3]);
+    double threshold = argc > 4 ? boost::lexical_cast<double>(argv[4]) : 0.05;
+
+    // every metric is better when lower
+    static const char* metrics[] = {
+        "mean_ns", "p50_ns", "p99_ns", "counters.instructions"
+    };
+
+    size_t regressions = 0;
+    for (auto const& kv: current) {
+        auto const& name = kv.first;
+        auto base = baseline.find(name);
+        if (base == baseline.end()) {
+            std::cout << name.first << " " << name.second
+                      << ": not in the baseline" << std::endl;
+            continue;
+        }
+        for (const char* metric: metrics) {
+            auto before = base->second.get_optional<double>(metric);
+            auto after = kv.second.get_optional<double>(metric);
+            if (!before || !after || *before <= 0) continue;
+            double change = *after / *before - 1;
+            bool regression = change > threshold;
+            regressions += regression;
+            std::cout << name.first << " " << name.second << " " << metric
+                      << ": " << *before << " -> " << *after << " ("
+                      << std::showpos << change * 100 << std::noshowpos << "%)"
+                      << (regression ? " REGRESSION" : "") << std::endl;
+        }
+    }
+
+    logger() << regressions << " regressions above "
+             << threshold * 100 << "%" << std::endl;
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace quasi_succinct;
+
+    std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "run" && argc >= 5) {
+        return run(argc, argv);
+    } else if (mode == "compare" && argc >= 4) {
+        return compare(argc, argv);
+    }
+
+    std::cerr << "Usage: " << argv[0]
+              << " run <index prefix> <wand data | -> <output.json> [types...] < queries\n"
+              << "       " << argv[0]
+              << " compare <baseline.json> <current.json> [threshold]"
+              << std::endl;
+    return 1;
+}
@@ -0,0 +1,486 @@
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "binary_freq_collection.hpp"
+#include "bitpacked_sequence.hpp"
+#include "block_codecs.hpp"
+#include "block_posting_list.hpp"
+#include "compact_elias_fano.hpp"
+#include "compact_ranked_bitvector.hpp"
+#include "decode_cost.hpp"
+#include "indexed_sequence.hpp"
+#include "partitioned_sequence.hpp"
+#include "strict_sequence.hpp"
+#include "uniform_partitioned_sequence.hpp"
+#include "util.hpp"
+
+// Microbenchmarks of the sequence encoders and of the block codecs (through
+// block_posting_list): encode throughput, bits per element, and the cost
+// of next, and of move and next_geq at several skip distances. The inputs
+// are synthetic sequences with uniform, clustered and zipfian gaps, and
+// optionally the longest lists of a collection.
+
+using namespace quasi_succinct;
+
+struct bench_input {
+    std::string name;
+    uint64_t universe;
+    std::vector<std::vector<uint64_t>> lists;
+};
+
+// Gives the sequences and the block posting lists the same interface: an
+// encoded list, and an enumerator whose operations return the value.
+// strict_sequence has no next_geq, so it is benchmarked with HasNextGeq
+// false
+template <typename Sequence, bool HasNextGeq = true>
+struct sequence_adapter {
+    static const bool has_next_geq = HasNextGeq;
+
+    struct encoded {
+        succinct::bit_vector bv;
+        uint64_t universe;
+        uint64_t n;
+    };
+
+    static void encode(std::vector<uint64_t> const& seq, uint64_t universe,
+                       encoded& out)
+    {
+        global_parameters params;
+        succinct::bit_vector_builder bvb;
+        Sequence::write(bvb, seq.begin(), universe, seq.size(), params);
+        succinct::bit_vector(&bvb).swap(out.bv);
+        out.universe = universe;
+        out.n = seq.size();
+    }
+
+    static uint64_t bits(encoded const& list)
+    {
+        return list.bv.size();
+    }
+
+    class enumerator {
+    public:
+        enumerator(encoded const& list)
+            : m_enum(list.bv, 0, list.universe, list.n, m_params)
+        {
+            m_enum.move(0);
+        }
+
+        uint64_t next() { return m_enum.next().second; }
+        uint64_t move(uint64_t pos) { return m_enum.move(pos).second; }
+        uint64_t next_geq(uint64_t lb)
+        {
+            return next_geq(lb, std::integral_constant<bool, HasNextGeq>());
+        }
+
+    private:
+        uint64_t next_geq(uint64_t lb, std::true_type)
+        {
+            return m_enum.next_geq(lb).second;
+        }
+
+        uint64_t next_geq(uint64_t, std::false_type)
+        {
+            assert(false);
+            return 0;
+        }
+
+        global_parameters m_params;
+        typename Sequence::enumerator m_enum;
+    };
+};
+
+// the frequencies are all 1 and their size is not counted
+template <typename BlockCodec>
+struct block_adapter {
+    typedef block_posting_list<BlockCodec> posting_list_type;
+    static const bool has_next_geq = true;
+
+    struct encoded {
+        std::vector<uint8_t> data;
+        uint64_t universe;
+    };
+
+    static void encode(std::vector<uint64_t> const& seq, uint64_t universe,
+                       encoded& out)
+    {
+        std::vector<uint32_t> freqs(seq.size(), 1);
+        out.data.clear();
+        posting_list_type::write(out.data, uint32_t(seq.size()),
+                                 seq.begin(), freqs.begin());
+        out.universe = universe;
+    }
+
+    static uint64_t bits(encoded const& list)
+    {
+        typename posting_list_type::document_enumerator e(list.data.data(),
+                                                          list.universe);
+        return 8 * (list.data.size() - e.stats_freqs_size());
+    }
+
+    class enumerator {
+    public:
+        enumerator(encoded const& list)
+            : m_enum(list.data.data(), list.universe)
+        {}
+
+        uint64_t next() { m_enum.next(); return m_enum.docid(); }
+        uint64_t move(uint64_t pos) { m_enum.move(pos); return m_enum.docid(); }
+        uint64_t next_geq(uint64_t lb) { m_enum.next_geq(lb); return m_enum.docid(); }
+
+    private:
+        typename posting_list_type::document_enumerator m_enum;
+    };
+};
+
+// best of three runs of f, which returns the number of operations timed
+template <typename Functor>
+double best_nsecs_per_op(Functor f)
+{
+    double best = std::numeric_limits<double>::max();
+    for (size_t run = 0; run < 3; ++run) {
+        uint64_t tick = tsc_clock::now();
+        uint64_t ops = f();
+        double ns = tsc_clock::nsecs(tsc_clock::now() - tick);
+        best = std::min(best, ns / std::max<uint64_t>(ops, 1));
+    }
+    return best;
+}
+
+template <typename Adapter>
+void bench_encoder(std::string const& encoder, bench_input const& input)
+{
+    typedef typename Adapter::encoded encoded;
+    typedef typename Adapter::enumerator enumerator;
+
+    uint64_t elements = 0;
+    for (auto const& list: input.lists) {
+        elements += list.size();
+    }
+
+    std::vector<encoded> lists(input.lists.size());
+    double encode_ns = best_nsecs_per_op([&]() {
+            for (size_t l = 0; l < lists.size(); ++l) {
+                Adapter::encode(input.lists[l], input.universe, lists[l]);
+            }
+            return elements;
+        });
+    uint64_t bits = 0;
+    for (auto const& list: lists) {
+        bits += Adapter::bits(list);
+    }
+
+    logger() << encoder << " on " << input.name << ": "
+             << double(bits) / elements << " bits/element" << std::endl;
+    stats_line()
+        ("encoder", encoder)
+        ("input", input.name)
+        ("elements", elements)
+        ("bits_per_element", double(bits) / elements)
+        ("encode_ns_per_element", encode_ns)
+        ("encode_melements_per_sec", 1000 / encode_ns)
+        ;
+
+    uint64_t checksum = 0;
+    double next_ns = best_nsecs_per_op([&]() {
+            for (size_t l = 0; l < lists.size(); ++l) {
+                enumerator e(lists[l]);
+                for (size_t i = 1; i < input.lists[l].size(); ++i) {
+                    checksum += e.next();
+                }
+            }
+            return elements;
+        });
+    stats_line()
+        ("encoder", encoder)
+        ("input", input.name)
+        ("op", "next")
+        ("skip", 1)
+        ("ns_per_op", next_ns)
+        ;
+
+    // every pass over the lists does elements / skip operations, so it is
+    // repeated to time at least min_ops of them
+    static const uint64_t min_ops = 1 << 18;
+    for (uint64_t skip = 1; skip <= 4096; skip *= 4) {
+        auto skip_op = [&](bool geq) {
+            return best_nsecs_per_op([&]() {
+                    uint64_t ops = 0;
+                    while (ops < min_ops) {
+                        uint64_t pass_ops = 0;
+                        for (size_t l = 0; l < lists.size(); ++l) {
+                            auto const& seq = input.lists[l];
+                            enumerator e(lists[l]);
+                            for (size_t i = skip; i < seq.size(); i += skip) {
+                                checksum += geq ? e.next_geq(seq[i - 1] + 1) : e.move(i);
+                                ++pass_ops;
+                            }
+                        }
+                        if (!pass_ops) break;
+                        ops += pass_ops;
+                    }
+                    return ops;
+                });
+        };
+
+        stats_line()
+            ("encoder", encoder)
+            ("input", input.name)
+            ("op", "move")
+            ("skip", skip)
+            ("ns_per_op", skip_op(false))
+            ;
+        if (Adapter::has_next_geq) {
+            stats_line()
+                ("encoder", encoder)
+                ("input", input.name)
+                ("op", "next_geq")
+                ("skip", skip)
+                ("ns_per_op", skip_op(true))
+                ;
+        }
+    }
+    do_not_optimize_away(checksum);
+}
+
+void bench_all(bench_input const& input)
+{
+    logger() << "Input " << input.name << ": " << input.lists.size()
+             << " lists, universe " << input.universe << std::endl;
+
+    bench_encoder<sequence_adapter<compact_elias_fano>>("compact_elias_fano", input);
+    bench_encoder<sequence_adapter<compact_ranked_bitvector>>("compact_ranked_bitvector", input);
+    bench_encoder<sequence_adapter<indexed_sequence>>("indexed_sequence", input);
+    bench_encoder<sequence_adapter<bitpacked_sequence>>("bitpacked_sequence", input);
+    bench_encoder<sequence_adapter<strict_sequence, false>>("strict_sequence", input);
+    bench_encoder<sequence_adapter<uniform_partitioned_sequence<>>>("uniform_partitioned_sequence", input);
+    bench_encoder<sequence_adapter<partitioned_sequence<>>>("partitioned_sequence", input);
+    bench_encoder<sequence_adapter<partitioned_sequence<bitpacked_indexed_sequence>>>(
+        "partitioned_bitpacked_sequence", input);
+
+    bench_encoder<block_adapter<optpfor_block>>("block_optpfor", input);
+    bench_encoder<block_adapter<varint_G8IU_block>>("block_varint", input);
+    bench_encoder<block_adapter<interpolative_block>>("block_interpolative", input);
+    bench_encoder<block_adapter<u32_block>>("block_u32", input);
+    bench_encoder<block_adapter<vbyte_block>>("block_vbyte", input);
+    bench_encoder<block_adapter<simple16_block>>("block_simple16", input);
+    bench_encoder<block_adapter<simdbp128_block>>("block_simdbp128", input);
+    bench_encoder<block_adapter<simd_pfor_block>>("block_simd_pfor", input);
+}
+
+// Times next() on lists of 4096 values with uniform gaps, at each average
+// gap of the decode_cost tables, and reports it next to the model
+template <typename Sequence>
+void calibrate_decode_cost(std::string const& encoder, decode_cost::encoding e,
+                           size_t max_log_gap)
+{
+    typedef sequence_adapter<Sequence> adapter;
+    static const uint64_t n = 4096;
+    static const size_t num_lists = 256;
+    std::mt19937_64 rng(42);
+
+    for (size_t log_gap = 0; log_gap <= max_log_gap; ++log_gap) {
+        std::uniform_int_distribution<uint64_t> gap(0, 2 * ((uint64_t(1) << log_gap) - 1));
+        std::vector<typename adapter::encoded> lists(num_lists);
+        uint64_t universe = 0;
+        for (auto& list: lists) {
+            std::vector<uint64_t> seq(n);
+            uint64_t value = 0;
+            for (auto& v: seq) {
+                v = value;
+                value += 1 + gap(rng);
+            }
+            // the universe of a partition is tight
+            adapter::encode(seq, seq.back() + 1, list);
+            universe += seq.back() + 1;
+        }
+
+        uint64_t checksum = 0;
+        double ns = best_nsecs_per_op([&]() {
+                for (auto const& list: lists) {
+                    typename adapter::enumerator en(list);
+                    for (size_t i = 1; i < n; ++i) {
+                        checksum += en.next();
+                    }
+                }
+                return n * num_lists;
+            });
+        do_not_optimize_away(checksum);
+
+        stats_line()
+            ("calibration", encoder)
+            ("avg_gap", uint64_t(1) << log_gap)
+            ("ns_per_element", ns)
+            ("model_ns_per_element",
+             decode_cost::ns_per_element(e, universe / num_lists, n))
+            ;
+    }
+}
+
+void calibrate_all()
+{
+    calibrate_decode_cost<compact_elias_fano>("elias_fano", decode_cost::elias_fano,
+                                              decode_cost::max_log_gap);
+    calibrate_decode_cost<compact_ranked_bitvector>("ranked_bitvector",
+                                                    decode_cost::ranked_bitvector,
+                                                    decode_cost::max_log_gap);
+    calibrate_decode_cost<all_ones_sequence>("all_ones", decode_cost::all_ones, 0);
+    calibrate_decode_cost<bitpacked_sequence>("bitpacked", decode_cost::bitpacked,
+                                              decode_cost::max_log_gap);
+}
+
+// Times the optimal partitioning of the lists of a collection with the
+// cost function of partitioned_sequence, and the whole
+// partitioned_sequence::write, for each range of list sizes
+template <typename BaseSequence>
+void bench_partition(std::string const& name,
+                     std::vector<std::vector<uint64_t>> const& lists)
+{
+    auto const& conf = configuration::get();
+    global_parameters params;
+    auto cost_fun = [&](uint64_t universe, uint64_t n) {
+        return BaseSequence::best_type(params, universe, n, conf.speed_lambda).second
+            + conf.fix_cost;
+    };
+
+    for (uint64_t min_size = 1; min_size < (uint64_t(1) << 32); min_size *= 16) {
+        std::vector<std::vector<uint64_t> const*> range;
+        uint64_t postings = 0;
+        for (auto const& list: lists) {
+            if (list.size() >= min_size && list.size() < 16 * min_size) {
+                range.push_back(&list);
+                postings += list.size();
+            }
+        }
+        if (range.empty()) continue;
+
+        uint64_t partitions = 0;
+        double partition_ns = best_nsecs_per_op([&]() {
+                partitions = 0;
+                for (auto list: range) {
+                    optimal_partition opt(list->begin(), list->back() + 1, list->size(),
+                                          cost_fun, conf.eps1, conf.eps2);
+                    partitions += opt.partition.size();
+                }
+                return postings;
+            });
+
+        double write_ns = best_nsecs_per_op([&]() {
+                for (auto list: range) {
+                    succinct::bit_vector_builder bvb;
+                    partitioned_sequence<BaseSequence>::write(
+                        bvb, list->begin(), list->back() + 1, list->size(), params);
+                    do_not_optimize_away(bvb.size());
+                }
+                return postings;
+            });
+
+        stats_line()
+            ("partition", name)
+            ("min_size", min_size)
+            ("lists", range.size())
+            ("postings", postings)
+            ("partitions", partitions)
+            ("partition_ns_per_posting", partition_ns)
+            ("write_ns_per_posting", write_ns)
+            ;
+    }
+}
+
+// a strictly increasing sequence of n values whose gaps minus one are
+// drawn from gap()
+template <typename GapFunctor>
+bench_input synthetic_input(std::string const& name, uint64_t n, GapFunctor gap)
+{
+    bench_input input;
+    input.name = name;
+    std::vector<uint64_t> seq(n);
+    uint64_t value = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+        seq[i] = value;
+        value += 1 + gap();
+    }
+    input.universe = value;
+    input.lists.push_back(std::move(seq));
+    return input;
+}
+
+int main(int argc, const char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "calibrate") {
+        calibrate_all();
+        return 0;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "partition") {
+        std::vector<std::vector<uint64_t>> lists;
+        binary_freq_collection coll(argv[2]);
+        for (auto const& plist: coll) {
+            lists.emplace_back(plist.docs.begin(), plist.docs.end());
+        }
+        bench_partition<indexed_sequence>("indexed_sequence", lists);
+        bench_partition<strict_sequence>("strict_sequence", lists);
+        return 0;
+    }
+
+    uint64_t n = 1 << 20;
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    std::vector<bench_input> inputs;
+
+    // average gap 8
+    std::uniform_int_distribution<uint64_t> uniform_gap(0, 14);
+    inputs.push_back(synthetic_input("uniform", n, [&]() {
+                return uniform_gap(rng);
+            }));
+
+    // runs of about 64 nearly consecutive values, separated by long jumps
+    inputs.push_back(synthetic_input("clustered", n, [&]() {
+                return unit(rng) < 1. / 64
+                    ? uint64_t(unit(rng) * 4096) : uint64_t(unit(rng) < 0.25);
+            }));
+
+    // P(gap >= g) ~ 1 / g, capped to keep the universe within 32 bits
+    inputs.push_back(synthetic_input("zipfian", n, [&]() {
+                return std::min<uint64_t>(uint64_t(1 / (1 - unit(rng))) - 1, 1 << 16);
+            }));
+
+    if (argc > 1) {
+        // the longest lists of the collection, with at least 4096 postings
+        static const size_t max_lists = 64;
+        binary_freq_collection coll(argv[1]);
+        bench_input input;
+        input.name = "collection";
+        input.universe = coll.num_docs();
+        for (auto const& plist: coll) {
+            size_t size = plist.docs.size();
+            if (size < 4096) continue;
+            input.lists.emplace_back(plist.docs.begin(), plist.docs.end());
+            // keep the longest max_lists lists
+            if (input.lists.size() > max_lists) {
+                auto shortest = std::min_element(
+                    input.lists.begin(), input.lists.end(),
+                    [](std::vector<uint64_t> const& a, std::vector<uint64_t> const& b) {
+                        return a.size() < b.size();
+                    });
+                input.lists.erase(shortest);
+            }
+        }
+        if (input.lists.empty()) {
+            logger() << "No list in " << argv[1]
+                     << " has at least 4096 postings" << std::endl;
+        } else {
+            inputs.push_back(std::move(input));
+        }
+    }
+
+    for (auto const& input: inputs) {
+        bench_all(input);
+    }
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "succinct/broadword.hpp"
+
+namespace quasi_succinct {
+
+    // Timestamps from the time stamp counter. Reading it costs a few
+    // nanoseconds, against the tens of a clock system call, and its
+    // resolution is below the nanosecond. On the CPUs we target the TSC is
+    // invariant: it ticks at a constant rate across cores and frequency
+    // changes. The rate is calibrated once against the steady clock.
+    class tsc_clock {
+    public:
+        static uint64_t now()
+        {
+            // keeps the read from moving before the preceding loads
+            _mm_lfence();
+            return __rdtsc();
+        }
+
+        static double nsecs_per_tick()
+        {
+            static const double ratio = calibrate();
+            return ratio;
+        }
+
+        static double nsecs(uint64_t ticks)
+        {
+            return double(ticks) * nsecs_per_tick();
+        }
+
+    private:
+        static double calibrate()
+        {
+            typedef std::chrono::steady_clock clock;
+            auto start = clock::now();
+            uint64_t tsc_start = now();
+            while (clock::now() - start < std::chrono::milliseconds(50));
+            uint64_t tsc_end = now();
+            auto end = clock::now();
+            double ns = std::chrono::duration<double, std::nano>(end - start).count();
+            return ns / double(tsc_end - tsc_start);
+        }
+    };
+
+    // A histogram of latencies in the style of HdrHistogram. The values
+    // below 2 * half_bucket get a bucket each. Above that, each power of
+    // two is split into half_bucket linear buckets. So a quantile is
+    // reported with a relative error below 1 / half_bucket at any
+    // magnitude, in constant space.
+    class latency_histogram {
+    public:
+        static const uint64_t half_bucket = 64;
+        static const size_t num_buckets = (64 - 7 + 2) * half_bucket;
+
+        latency_histogram()
+            : m_counts(num_buckets)
+            , m_count(0)
+            , m_sum(0)
+            , m_min(uint64_t(-1))
+            , m_max(0)
+        {}
+
+        void record(uint64_t value)
+        {
+            ++m_counts[bucket(value)];
+            ++m_count;
+            m_sum += value;
+            m_min = std::min(m_min, value);
+            m_max = std::max(m_max, value);
+        }
+
+        void merge(latency_histogram const& other)
+        {
+            for (size_t b = 0; b < num_buckets; ++b) {
+                m_counts[b] += other.m_counts[b];
+            }
+            m_count += other.m_count;
+            m_sum += other.m_sum;
+            m_min = std::min(m_min, other.m_min);
+            m_max = std::max(m_max, other.m_max);
+        }
+
+        uint64_t count() const
+        {
+            return m_count;
+        }
+
+        double mean() const
+        {
+            return m_count ? double(m_sum) / m_count : 0;
+        }
+
+        uint64_t min() const
+        {
+            return m_count ? m_min : 0;
+        }
+
+        uint64_t max() const
+        {
+            return m_max;
+        }
+
+        // the largest value equivalent to the value of rank ceil(q * count)
+        uint64_t quantile(double q) const
+        {
+            if (!m_count) return 0;
+            uint64_t rank = std::max<uint64_t>(1, uint64_t(std::ceil(q * m_count)));
+            uint64_t seen = 0;
+            for (size_t b = 0; b < num_buckets; ++b) {
+                seen += m_counts[b];
+                if (seen >= rank) {
+                    return std::min(upper_bound(b), m_max);
+                }
+            }
+            return m_max;
+        }
+
+        // calls f(upper_bound, count) for each non-empty bucket, in
+        // increasing order
+        template <typename Functor>
+        void for_each_bucket(Functor f) const
+        {
+            for (size_t b = 0; b < num_buckets; ++b) {
+                if (m_counts[b]) {
+                    f(std::min(upper_bound(b), m_max), m_counts[b]);
+                }
+            }
+        }
+
+        static size_t bucket(uint64_t value)
+        {
+            if (value < 2 * half_bucket) return value;
+            // the top 7 bits of the value, shifted to [half_bucket, 2 * half_bucket)
+            uint64_t shift = succinct::broadword::msb(value) - 6;
+            return shift * half_bucket + (value >> shift);
+        }
+
+        static uint64_t upper_bound(size_t b)
+        {
+            if (b < 2 * half_bucket) return b;
+            uint64_t shift = b / half_bucket - 1;
+            uint64_t mantissa = b - shift * half_bucket;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+    private:
+        std::vector<uint64_t> m_counts;
+        uint64_t m_count;
+        uint64_t m_sum;
+        uint64_t m_min;
+        uint64_t m_max;
+    };
+
+    // Counts hardware events of the calling thread with perf_event_open.
+    // Only user space is counted, so this works with the default
+    // perf_event_paranoid. The events are opened as one group, so they are
+    // scheduled together and their ratios are consistent. If the group is
+    // multiplexed, the counts are scaled by the fraction of time it ran.
+    // Events that the kernel or the CPU do not provide (as in most VMs and
+    // containers) are not available and read as zero.
+    class perf_counters {
+    public:
+        enum event {
+            cycles,
+            instructions,
+            cache_misses,
+            branch_misses,
+            num_events
+        };
+
+        static const char* name(event e)
+        {
+            static const char* names[] = {
+                "cycles", "instructions", "cache_misses", "branch_misses"
+            };
+            return names[e];
+        }
+
+        perf_counters()
+            : m_leader(-1)
+        {
+            static const uint64_t configs[] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES
+            };
+
+            size_t opened = 0;
+            for (size_t e = 0; e < num_events; ++e) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = configs[e];
+                attr.disabled = m_leader < 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP
+                    | PERF_FORMAT_TOTAL_TIME_ENABLED
+                    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                m_fds[e] = int(syscall(__NR_perf_event_open, &attr, 0, -1,
+                                       m_leader, 0));
+                if (m_fds[e] >= 0) {
+                    if (m_leader < 0) m_leader = m_fds[e];
+                    m_slots[e] = opened++;
+                }
+                m_values[e] = 0;
+            }
+        }
+
+        ~perf_counters()
+        {
+            for (size_t e = 0; e < num_events; ++e) {
+                if (m_fds[e] >= 0) ::close(m_fds[e]);
+            }
+        }
+
+        bool available(event e) const
+        {
+            return m_fds[e] >= 0;
+        }
+
+        // resets and enables the counters
+        void start()
+        {
+            if (m_leader < 0) return;
+            ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        // disables the counters and reads them
+        void stop()
+        {
+            if (m_leader < 0) return;
+            ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+            uint64_t buf[3 + num_events];
+            if (::read(m_leader, buf, sizeof(buf)) < ssize_t(3 * sizeof(uint64_t))) {
+                return;
+            }
+            uint64_t enabled = buf[1], running = buf[2];
+            double scale = running ? double(enabled) / running : 0;
+            for (size_t e = 0; e < num_events; ++e) {
+                if (m_fds[e] >= 0) {
+                    m_values[e] = uint64_t(double(buf[3 + m_slots[e]]) * scale);
+                }
+            }
+        }
+
+        // the count of the last start()/stop() interval
+        uint64_t value(event e) const
+        {
+            return m_values[e];
+        }
+
+    private:
+        perf_counters(perf_counters const&);
+        perf_counters& operator=(perf_counters const&);
+
+        int m_leader;
+        int m_fds[num_events];
+        size_t m_slots[num_events];
+        uint64_t m_values[num_events];
+    };
+
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <succinct/bit_vector.hpp>
+#include <succinct/broadword.hpp>
+
+#include "global_parameters.hpp"
+#include "simd_bitpacking.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // The gaps minus one of the sequence, in blocks of 128 bit packed with
+    // simd_bitpacking, all at the width of the largest gap. The last
+    // value of each block is sampled, for random access and next_geq.
+    // This takes more space than Elias-Fano unless the gaps are all
+    // small, but a block is decoded with a few SSE instructions per four
+    // values, and next and move within it only read the decoded buffer.
+    // It suits the partitions that are dense but too irregular for a
+    // ranked bitvector.
+    struct bitpacked_sequence {
+
+        static const uint64_t block_size = simd_bitpacking::block_size;
+        static const uint64_t width_bits = 6;
+
+        struct offsets {
+            offsets(uint64_t base_offset,
+                    uint64_t universe,
+                    uint64_t n,
+                    uint64_t width)
+                : universe(universe)
+                , n(n)
+                , width(width)
+
+                , sample_size(ceil_log2(universe))
+                , blocks(succinct::util::ceil_div(n, block_size))
+
+                , samples_offset(base_offset + width_bits)
+                , values_offset(samples_offset + blocks * sample_size)
+                , end(values_offset + n * width)
+            {}
+
+            uint64_t universe;
+            uint64_t n;
+            uint64_t width;
+
+            uint64_t sample_size;
+            uint64_t blocks;
+
+            uint64_t samples_offset;
+            uint64_t values_offset;
+            uint64_t end;
+        };
+
+        // the decoded values are 32 bits
+        static bool fits(uint64_t universe)
+        {
+            return universe <= (uint64_t(1) << 32);
+        }
+
+        static uint64_t width(uint64_t max_gap)
+        {
+            return max_gap ? succinct::broadword::msb(max_gap) + 1 : 0;
+        }
+
+        // the largest gap minus one, counting the first value as a gap from -1
+        template <typename Iterator>
+        static uint64_t max_gap(Iterator begin, uint64_t n)
+        {
+            uint64_t result = 0;
+            uint64_t next = 0; // the previous value plus one
+            for (uint64_t i = 0; i < n; ++i, ++begin) {
+                uint64_t v = *begin;
+                if (i && v < next) {
+                    throw std::runtime_error("Sequence is not strictly increasing");
+                }
+                result = std::max(result, v - next);
+                next = v + 1;
+            }
+            return result;
+        }
+
+        static uint64_t
+        bitsize(global_parameters const& /* params */, uint64_t universe, uint64_t n,
+                uint64_t max_gap)
+        {
+            if (!fits(universe)) return uint64_t(-1);
+            return offsets(0, universe, n, width(max_gap)).end;
+        }
+
+        template <typename Iterator>
+        static void write(succinct::bit_vector_builder& bvb,
+                          Iterator begin,
+                          uint64_t universe, uint64_t n,
+                          global_parameters const& /* params */)
+        {
+            if (!fits(universe)) {
+                throw std::invalid_argument("Universe does not fit in 32 bits");
+            }
+            uint64_t b = width(max_gap(begin, n));
+            offsets of(bvb.size(), universe, n, b);
+            bvb.append_bits(b, width_bits);
+
+            Iterator it = begin;
+            for (uint64_t i = 0; i < n; ++i, ++it) {
+                if ((i + 1) % block_size == 0 || i + 1 == n) {
+                    bvb.append_bits(*it, of.sample_size);
+                }
+            }
+
+            uint32_t gaps[block_size];
+            uint64_t packed[2 * 32];
+            uint64_t next = 0;
+            it = begin;
+            for (uint64_t i = 0; i < n; i += block_size) {
+                uint64_t len = std::min(uint64_t(block_size), n - i);
+                for (uint64_t j = 0; j < len; ++j, ++it) {
+                    gaps[j] = uint32_t(*it - next);
+                    next = *it + 1;
+                }
+                if (len == block_size) {
+                    simd_bitpacking::pack(gaps, reinterpret_cast<uint8_t*>(packed),
+                                          uint32_t(b));
+                    for (uint64_t w = 0; w < 2 * b; ++w) {
+                        bvb.append_bits(packed[w], 64);
+                    }
+                } else {
+                    for (uint64_t j = 0; j < len; ++j) {
+                        bvb.append_bits(gaps[j], b);
+                    }
+                }
+            }
+            assert(bvb.size() == of.end); (void)of;
+        }
+
+        class enumerator {
+        public:
+
+            typedef std::pair<uint64_t, uint64_t> value_type; // (position, value)
+
+            enumerator(succinct::bit_vector const& bv, uint64_t offset,
+                       uint64_t universe, uint64_t n,
+                       global_parameters const& /* params */)
+                : m_bv(&bv)
+                , m_of(offset, universe, n,
+                       bv.get_word56(offset) & ((uint64_t(1) << width_bits) - 1))
+                , m_position(size())
+                , m_value(m_of.universe)
+                , m_block(m_of.blocks)
+            {}
+
+            value_type move(uint64_t position)
+            {
+                assert(position <= size());
+                m_position = position;
+                if (QS_UNLIKELY(m_position == size())) {
+                    m_value = m_of.universe;
+                    return value();
+                }
+
+                uint64_t block = m_position / block_size;
+                if (QS_UNLIKELY(block != m_block)) {
+                    decode_block(block);
+                }
+                m_value = m_buf[m_position % block_size];
+                return value();
+            }
+
+            value_type next_geq(uint64_t lower_bound)
+            {
+                if (QS_LIKELY(m_block != m_of.blocks
+                              && lower_bound >= m_block_lower
+                              && lower_bound <= m_block_upper)) {
+                    uint64_t i = 0;
+                    if (m_position / block_size == m_block && lower_bound >= m_value) {
+                        i = m_position % block_size;
+                    }
+                    // the last value of the block is the upper bound
+                    while (m_buf[i] < lower_bound) ++i;
+                    m_position = m_block * block_size + i;
+                    m_value = m_buf[i];
+                    return value();
+                }
+                return slow_next_geq(lower_bound);
+            }
+
+            value_type next()
+            {
+                return move(m_position + 1);
+            }
+
+            uint64_t size() const
+            {
+                return m_of.n;
+            }
+
+            uint64_t prev_value() const
+            {
+                if (m_position == 0) {
+                    return 0;
+                }
+
+                uint64_t pos = m_position - 1;
+                if (pos / block_size == m_block) {
+                    return m_buf[pos % block_size];
+                }
+                // otherwise pos is the last of its block
+                return sample(pos / block_size);
+            }
+
+            // Decodes the values in [position, position + count) into out
+            // and leaves the enumerator on the last one.
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+
+                uint64_t end = position + count;
+                while (position < end) {
+                    move(position);
+                    uint64_t in_block = position % block_size;
+                    uint64_t len = std::min(end - position, uint64_t(block_size) - in_block);
+                    std::copy(m_buf + in_block, m_buf + in_block + len, out);
+                    out += len;
+                    position += len;
+                }
+                move(end - 1);
+            }
+
+        private:
+
+            value_type QS_NOINLINE slow_next_geq(uint64_t lower_bound)
+            {
+                if (QS_UNLIKELY(!size() || lower_bound > sample(m_of.blocks - 1))) {
+                    return move(size());
+                }
+
+                // the first block whose last value is at least lower_bound
+                uint64_t lo = 0, hi = m_of.blocks - 1;
+                if (m_block != m_of.blocks && lower_bound > m_block_upper) {
+                    lo = m_block + 1;
+                }
+                while (lo < hi) {
+                    uint64_t mid = (lo + hi) / 2;
+                    if (sample(mid) < lower_bound) {
+                        lo = mid + 1;
+                    } else {
+                        hi = mid;
+                    }
+                }
+
+                decode_block(lo);
+                m_position = lo * block_size;
+                return next_geq(lower_bound);
+            }
+
+            void QS_NOINLINE decode_block(uint64_t block)
+            {
+                m_block = block;
+                m_block_lower = block ? sample(block - 1) + 1 : 0;
+                m_block_upper = sample(block);
+
+                uint64_t b = m_of.width;
+                uint64_t pos = m_of.values_offset + block * block_size * b;
+                uint64_t len = std::min(uint64_t(block_size), size() - block * block_size);
+                if (len == block_size) {
+                    // the block is not aligned in the bit vector, so it is
+                    // copied to a word buffer first
+                    uint64_t packed[2 * 32];
+                    for (uint64_t w = 0; w < 2 * b; ++w) {
+                        packed[w] = m_bv->get_bits(pos + 64 * w, 64);
+                    }
+                    simd_bitpacking::unpack_delta(reinterpret_cast<uint8_t const*>(packed),
+                                                  m_buf, uint32_t(b),
+                                                  uint32_t(m_block_lower));
+                } else {
+                    uint32_t value = uint32_t(m_block_lower) - 1;
+                    for (uint64_t i = 0; i < len; ++i) {
+                        value += uint32_t(m_bv->get_bits(pos + i * b, b)) + 1;
+                        m_buf[i] = value;
+                    }
+                }
+            }
+
+            inline value_type value() const
+            {
+                return value_type(m_position, m_value);
+            }
+
+            inline uint64_t sample(uint64_t block) const
+            {
+                return m_bv->get_word56(m_of.samples_offset + block * m_of.sample_size)
+                    & ((uint64_t(1) << m_of.sample_size) - 1);
+            }
+
+            succinct::bit_vector const* m_bv;
+            offsets m_of;
+
+            uint64_t m_position;
+            uint64_t m_value;
+            uint64_t m_block; // the decoded block, blocks if none
+            uint64_t m_block_lower;
+            uint64_t m_block_upper;
+            uint32_t m_buf[block_size];
+        };
+    };
+}
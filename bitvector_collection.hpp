@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+
 #include <succinct/bit_vector.hpp>
 
 #include "compact_elias_fano.hpp"
@@ -44,6 +49,108 @@ namespace quasi_succinct {
             succinct::bit_vector_builder m_bitvectors;
         };
 
+        // Same as builder, but once more than max_memory bytes of bits are
+        // buffered the complete words are appended to tmp_filename, so that
+        // the collection never needs to be in memory as a whole. freeze()
+        // then writes it out in the same layout as map().
+        class stream_builder {
+        public:
+            stream_builder(global_parameters const& params,
+                           std::string const& tmp_filename,
+                           size_t max_memory)
+                : m_params(params)
+                , m_tmp_filename(tmp_filename)
+                , m_max_memory(max_memory)
+                , m_flushed_words(0)
+            {
+                m_endpoints.push_back(0);
+                // truncate leftovers of previous runs
+                std::ofstream(m_tmp_filename.c_str(), std::ios::binary);
+            }
+
+            ~stream_builder()
+            {
+                std::remove(m_tmp_filename.c_str());
+            }
+
+            void append(succinct::bit_vector_builder& bvb)
+            {
+                m_bitvectors.append(bvb);
+                m_endpoints.push_back(size());
+                if (m_bitvectors.size() / 8 > m_max_memory) {
+                    flush();
+                }
+            }
+
+            uint64_t size() const
+            {
+                return m_flushed_words * 64 + m_bitvectors.size();
+            }
+
+            template <typename Freezer>
+            void freeze(Freezer& freezer, std::ofstream& fout)
+            {
+                uint64_t n = m_endpoints.size() - 1;
+                uint64_t bits_size = size();
+
+                succinct::bit_vector_builder bvb;
+                compact_elias_fano::write(bvb, m_endpoints.begin(),
+                                          bits_size, n, m_params);
+                succinct::bit_vector endpoints(&bvb);
+
+                // same sequence of fields as map(), with m_bitvectors
+                // expanded into the fields of bit_vector and its
+                // mappable_vector, whose data is copied verbatim
+                uint64_t words = (bits_size + 63) / 64;
+                freezer
+                    (n, "m_size")
+                    (endpoints, "m_endpoints")
+                    (bits_size, "m_size")
+                    (words, "size")
+                    ;
+
+                std::ifstream tmp(m_tmp_filename.c_str(), std::ios::binary);
+                std::vector<char> buf(1 << 20);
+                while (tmp.read(buf.data(), buf.size()) || tmp.gcount()) {
+                    fout.write(buf.data(), tmp.gcount());
+                }
+                auto const& tail = m_bitvectors.move_bits();
+                fout.write(reinterpret_cast<char const*>(tail.data()),
+                           tail.size() * sizeof(uint64_t));
+            }
+
+        private:
+
+            void flush()
+            {
+                // write the complete words and keep the last partial one
+                auto& bits = m_bitvectors.move_bits();
+                uint64_t complete = m_bitvectors.size() / 64;
+                uint64_t rem = m_bitvectors.size() % 64;
+                std::ofstream tmp(m_tmp_filename.c_str(),
+                                  std::ios::binary | std::ios::app);
+                tmp.write(reinterpret_cast<char const*>(bits.data()),
+                          complete * sizeof(uint64_t));
+                if (!tmp) {
+                    throw std::runtime_error("Error writing " + m_tmp_filename);
+                }
+                m_flushed_words += complete;
+
+                succinct::bit_vector_builder rest;
+                if (rem) {
+                    rest.append_bits(bits[complete], rem);
+                }
+                m_bitvectors.swap(rest);
+            }
+
+            global_parameters m_params;
+            std::string m_tmp_filename;
+            size_t m_max_memory;
+            uint64_t m_flushed_words;
+            std::vector<uint64_t> m_endpoints;
+            succinct::bit_vector_builder m_bitvectors;
+        };
+
         size_t size() const
         {
             return m_size;
@@ -58,14 +165,20 @@ namespace quasi_succinct {
         get(global_parameters const& params, size_t i) const
         {
             assert(i < size());
-            compact_elias_fano::enumerator endpoints(m_endpoints, 0,
-                                                     m_bitvectors.size(), m_size,
-                                                     params);
-
-            auto endpoint = endpoints.move(i).second;
+            auto endpoint = endpoints(params).move(i).second;
             return succinct::bit_vector::enumerator(m_bitvectors, endpoint);
         }
 
+        // the i-th element is the position in bits() where the i-th
+        // bitvector begins
+        compact_elias_fano::enumerator
+        endpoints(global_parameters const& params) const
+        {
+            return compact_elias_fano::enumerator(m_endpoints, 0,
+                                                  m_bitvectors.size(), m_size,
+                                                  params);
+        }
+
         void swap(bitvector_collection& other)
         {
             std::swap(m_size, other.m_size);
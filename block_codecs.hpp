@@ -1,5 +1,15 @@
 #pragma once
 
+#include <type_traits>
+
+#include <emmintrin.h>
+
+#include <boost/preprocessor/repetition/enum.hpp>
+
+#include "succinct/broadword.hpp"
+
+#include "simd_bitpacking.hpp"
+
 #include "FastPFor/headers/optpfor.h"
 #include "FastPFor/headers/variablebyte.h"
 #include "FastPFor/headers/VarIntG8IU.h"
@@ -151,18 +161,19 @@ namespace quasi_succinct {
                            size_t n, std::vector<uint8_t>& out)
         {
             assert(n <= block_size);
-            // XXX this could be threadlocal static
-            std::vector<uint8_t> buf(2 * 4 * block_size);
-            size_t out_len = buf.size();
+            // the scratch buffer is on the stack, so that encoding a block
+            // does not allocate
+            uint32_t buf[2 * block_size];
+            uint8_t* bufptr = reinterpret_cast<uint8_t*>(buf);
+            size_t out_len = sizeof(buf);
 
             if (n == block_size) {
-                optpfor_codec.encodeBlock(in, reinterpret_cast<uint32_t*>(buf.data()),
-                                          out_len);
+                optpfor_codec.encodeBlock(in, buf, out_len);
                 out_len *= 4;
             } else {
-                vbyte_codec.encode(in, n, buf.data(), out_len);
+                vbyte_codec.encode(in, n, bufptr, out_len);
             }
-            out.insert(out.end(), buf.data(), buf.data() + out_len);
+            out.insert(out.end(), bufptr, bufptr + out_len);
         }
 
         static uint8_t const* decode(uint8_t const* in, uint32_t* out,
@@ -194,13 +205,12 @@ namespace quasi_succinct {
                            size_t n, std::vector<uint8_t>& out)
         {
             assert(n <= block_size);
-            // XXX this could be threadlocal static
-            std::vector<uint8_t> buf(2 * 4 * block_size);
-            size_t out_len = buf.size();
+            uint8_t buf[2 * 4 * block_size];
+            size_t out_len = sizeof(buf);
 
             if (n == block_size) {
                 const uint32_t * src = in;
-                unsigned char* dst = buf.data();
+                unsigned char* dst = buf;
                 size_t srclen = n * 4;
                 size_t dstlen = out_len;
                 out_len = 0;
@@ -209,9 +219,9 @@ namespace quasi_succinct {
                 }
                 assert(srclen == 0);
             } else {
-                vbyte_codec.encode(in, n, buf.data(), out_len);
+                vbyte_codec.encode(in, n, buf, out_len);
             }
-            out.insert(out.end(), buf.data(), buf.data() + out_len);
+            out.insert(out.end(), buf, buf + out_len);
         }
 
         static uint8_t const* decode(uint8_t const* in, uint32_t* out,
@@ -259,29 +269,53 @@ namespace quasi_succinct {
                            size_t n, std::vector<uint8_t>& out)
         {
             assert(n <= block_size);
-            std::vector<uint32_t> inbuf(n);
+            uint32_t inbuf[block_size];
             inbuf[0] = *in;
             for (size_t i = 1; i < n; ++i) {
                 inbuf[i] = inbuf[i - 1] + in[i] + 1;
             }
-            std::vector<uint32_t> buf(2 * block_size);
+            uint32_t buf[2 * block_size];
             if (sum_of_values == uint32_t(-1)) {
-                sum_of_values = inbuf.back() - (n - 1);
+                sum_of_values = inbuf[n - 1] - (n - 1);
                 TightVariableByte::encode_single(sum_of_values, out);
             }
 
             if (n > 1) {
                 uint32_t high = sum_of_values + n - 1;
-                integer_encoding::internals::BitsWriter bw(buf.data(), buf.size());
-                bw.intrpolatvArray(inbuf.data(), n - 1, 0, 0, high);
+                integer_encoding::internals::BitsWriter bw(buf, 2 * block_size);
+                bw.intrpolatvArray(inbuf, n - 1, 0, 0, high);
                 bw.flush_bits();
-                uint8_t const* bufptr = (uint8_t const*)buf.data();
+                uint8_t const* bufptr = (uint8_t const*)buf;
                 out.insert(out.end(), bufptr, bufptr + bw.size() * 4); // XXX wasting one word!
             }
         }
 
         static uint8_t const* decode(uint8_t const* in, uint32_t* out,
                                      uint32_t sum_of_values, size_t n)
+        {
+            uint8_t const* ret = decode_prefix_sums(in, out, sum_of_values, n);
+            for (size_t i = n - 1; i > 0; --i) {
+                out[i] -= out[i - 1] + 1;
+            }
+            return ret;
+        }
+
+        // the codec encodes the prefix sums, so the docids only need the
+        // base added
+        static uint8_t const* decode_docs(uint8_t const* in, uint32_t* out,
+                                          uint32_t sum_of_values, size_t n,
+                                          uint32_t base)
+        {
+            uint8_t const* ret = decode_prefix_sums(in, out, sum_of_values, n);
+            for (size_t i = 0; i < n; ++i) {
+                out[i] += base;
+            }
+            return ret;
+        }
+
+    private:
+        static uint8_t const* decode_prefix_sums(uint8_t const* in, uint32_t* out,
+                                                 uint32_t sum_of_values, size_t n)
         {
             assert(n <= block_size);
             uint8_t const* inbuf = in;
@@ -294,9 +328,6 @@ namespace quasi_succinct {
             if (n > 1) {
                 integer_encoding::internals::BitsReader br((uint32_t const*)inbuf, 2 * n);
                 br.intrpolatvArray(out, n - 1, 0, 0, high);
-                for (size_t i = n - 1; i > 0; --i) {
-                    out[i] -= out[i - 1] + 1;
-                }
                 return (uint8_t const*)(br.pos() + 1);
             } else {
                 return inbuf;
@@ -336,10 +367,11 @@ namespace quasi_succinct {
         static void encode(uint32_t const* in, uint32_t /* sum_of_values */,
                            size_t n, std::vector<uint8_t>& out)
         {
-            std::vector<uint8_t> buf(2 * 4 * block_size);
-            size_t out_len = buf.size();
-            TightVariableByte::encode(in, n, buf.data(), out_len);
-            out.insert(out.end(), buf.data(), buf.data() + out_len);
+            assert(n <= block_size);
+            uint8_t buf[2 * 4 * block_size];
+            size_t out_len = sizeof(buf);
+            TightVariableByte::encode(in, n, buf, out_len);
+            out.insert(out.end(), buf, buf + out_len);
         }
 
         static uint8_t const* decode(uint8_t const* in, uint32_t* out,
@@ -358,12 +390,12 @@ namespace quasi_succinct {
                            size_t n, std::vector<uint8_t>& out)
         {
             assert(n <= block_size);
-            // XXX this could be threadlocal static
-            std::vector<uint8_t> buf(2 * 8 * block_size);
-            size_t out_len = buf.size();
-            simple16_codec.encodeArray(in,n, reinterpret_cast<uint32_t*>(buf.data()),out_len);
+            uint32_t buf[2 * 2 * block_size];
+            uint8_t const* bufptr = reinterpret_cast<uint8_t const*>(buf);
+            size_t out_len = sizeof(buf);
+            simple16_codec.encodeArray(in, n, buf, out_len);
             out_len *= 4;
-            out.insert(out.end(), buf.data(), buf.data() + out_len);
+            out.insert(out.end(), bufptr, bufptr + out_len);
         }
 
         static uint8_t const* decode(uint8_t const* in, uint32_t* out,
@@ -381,4 +413,176 @@ namespace quasi_succinct {
         }
     };
 
+    // SIMD-BP128: a full block is stored as its bit width in one byte
+    // followed by the 128 values bit packed with simd_bitpacking, so a
+    // block is decoded with a few SSE instructions per four integers.
+    // Partial blocks use vbyte.
+    struct simdbp128_block {
+        static const uint64_t block_size = simd_bitpacking::block_size;
+
+        static void encode(uint32_t const* in, uint32_t /* sum_of_values */,
+                           size_t n, std::vector<uint8_t>& out)
+        {
+            assert(n <= block_size);
+            uint8_t buf[1 + 16 * 32];
+            size_t out_len = sizeof(buf);
+            if (n == block_size) {
+                uint32_t b = simd_bitpacking::bits(in);
+                buf[0] = uint8_t(b);
+                simd_bitpacking::pack(in, buf + 1, b);
+                out_len = 1 + simd_bitpacking::packed_bytes(b);
+            } else {
+                TightVariableByte::encode(in, n, buf, out_len);
+            }
+            out.insert(out.end(), buf, buf + out_len);
+        }
+
+        static uint8_t const* decode(uint8_t const* in, uint32_t* out,
+                                     uint32_t /* sum_of_values */, size_t n)
+        {
+            assert(n <= block_size);
+            if (n == block_size) {
+                uint32_t b = *in++;
+                simd_bitpacking::unpack(in, out, b);
+                return in + simd_bitpacking::packed_bytes(b);
+            } else {
+                return TightVariableByte::decode(in, out, n);
+            }
+        }
+
+        static uint8_t const* decode_docs(uint8_t const* in, uint32_t* out,
+                                          uint32_t /* sum_of_values */, size_t n,
+                                          uint32_t base)
+        {
+            assert(n <= block_size);
+            if (n == block_size) {
+                uint32_t b = *in++;
+                simd_bitpacking::unpack_delta(in, out, b, base);
+                return in + simd_bitpacking::packed_bytes(b);
+            } else {
+                uint8_t const* ret = TightVariableByte::decode(in, out, n);
+                delta_decoding::prefix_sum(out, n, base);
+                return ret;
+            }
+        }
+    };
+
+    // Patched frame of reference on top of simd_bitpacking: the width b is
+    // the one that minimizes the block size when the values that do not
+    // fit in b bits are stored as exceptions. A full block is laid out as
+    // b and the number of exceptions in one byte each, the positions of
+    // the exceptions in one byte each, the low b bits of all the values
+    // bit packed, and the high bits of the exceptions in vbyte. Partial
+    // blocks use vbyte.
+    struct simd_pfor_block {
+        static const uint64_t block_size = simd_bitpacking::block_size;
+
+        static void encode(uint32_t const* in, uint32_t /* sum_of_values */,
+                           size_t n, std::vector<uint8_t>& out)
+        {
+            assert(n <= block_size);
+            uint8_t buf[2 + block_size + 16 * 32 + 5 * block_size];
+            size_t out_len = sizeof(buf);
+            if (n < block_size) {
+                TightVariableByte::encode(in, n, buf, out_len);
+                out.insert(out.end(), buf, buf + out_len);
+                return;
+            }
+
+            uint32_t widths[33] = {0};
+            for (size_t i = 0; i < block_size; ++i) {
+                ++widths[in[i] ? succinct::broadword::msb(in[i]) + 1 : 0];
+            }
+            uint32_t max_b = 32;
+            while (max_b && !widths[max_b]) --max_b;
+
+            // an exception costs its position, plus its high bits in vbyte
+            uint32_t best_b = max_b;
+            size_t best_cost = simd_bitpacking::packed_bytes(max_b);
+            for (uint32_t b = 0; b < max_b; ++b) {
+                size_t cost = simd_bitpacking::packed_bytes(b);
+                for (uint32_t w = b + 1; w <= max_b; ++w) {
+                    cost += widths[w] * (1 + (w - b + 6) / 7);
+                }
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_b = b;
+                }
+            }
+
+            uint32_t highs[block_size];
+            size_t exceptions = 0;
+            uint8_t* positions = buf + 2;
+            for (size_t i = 0; i < block_size; ++i) {
+                uint32_t high = best_b == 32 ? 0 : in[i] >> best_b;
+                if (high) {
+                    positions[exceptions] = uint8_t(i);
+                    highs[exceptions++] = high;
+                }
+            }
+            buf[0] = uint8_t(best_b);
+            buf[1] = uint8_t(exceptions);
+            uint8_t* ptr = positions + exceptions;
+            simd_bitpacking::pack(in, ptr, best_b);
+            ptr += simd_bitpacking::packed_bytes(best_b);
+            size_t highs_len;
+            TightVariableByte::encode(highs, exceptions, ptr, highs_len);
+            out.insert(out.end(), buf, ptr + highs_len);
+        }
+
+        static uint8_t const* decode(uint8_t const* in, uint32_t* out,
+                                     uint32_t /* sum_of_values */, size_t n)
+        {
+            assert(n <= block_size);
+            if (n < block_size) {
+                return TightVariableByte::decode(in, out, n);
+            }
+
+            uint32_t b = in[0];
+            size_t exceptions = in[1];
+            uint8_t const* positions = in + 2;
+            in = positions + exceptions;
+            simd_bitpacking::unpack(in, out, b);
+            in += simd_bitpacking::packed_bytes(b);
+            if (exceptions) {
+                uint32_t highs[block_size];
+                in = TightVariableByte::decode(in, highs, exceptions);
+                for (size_t e = 0; e < exceptions; ++e) {
+                    out[positions[e]] |= highs[e] << b;
+                }
+            }
+            return in;
+        }
+    };
+
+    template <typename BlockCodec>
+    struct has_decode_docs
+    {
+        template <typename U> static char test(decltype(&U::decode_docs));
+        template <typename U> static int test(...);
+        enum { value = sizeof(test<BlockCodec>(0)) == sizeof(char) };
+    };
+
+    // Decodes a block of n docids whose gaps were encoded with
+    // BlockCodec::encode, the first of them relative to base. Codecs that
+    // can produce the docids while decoding define decode_docs; the
+    // others are decoded and then prefix-summed.
+    template <typename BlockCodec>
+    typename std::enable_if<has_decode_docs<BlockCodec>::value, uint8_t const*>::type
+    block_decode_docs(uint8_t const* in, uint32_t* out, uint32_t sum_of_values,
+                      size_t n, uint32_t base)
+    {
+        return BlockCodec::decode_docs(in, out, sum_of_values, n, base);
+    }
+
+    template <typename BlockCodec>
+    typename std::enable_if<!has_decode_docs<BlockCodec>::value, uint8_t const*>::type
+    block_decode_docs(uint8_t const* in, uint32_t* out, uint32_t sum_of_values,
+                      size_t n, uint32_t base)
+    {
+        uint8_t const* ret = BlockCodec::decode(in, out, sum_of_values, n);
+        delta_decoding::prefix_sum(out, n, base);
+        return ret;
+    }
+
 }
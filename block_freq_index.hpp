@@ -1,10 +1,17 @@
 #pragma once
 
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+
 #include <succinct/mappable_vector.hpp>
 #include <succinct/bit_vector.hpp>
+#include <succinct/mapper.hpp>
 
 #include "compact_elias_fano.hpp"
 #include "block_posting_list.hpp"
+#include "util.hpp"
 
 namespace quasi_succinct {
 
@@ -54,6 +61,104 @@ namespace quasi_succinct {
             std::vector<uint8_t> m_lists;
         };
 
+        // Writes the index to output_filename while it is being built: the
+        // encoded lists are spilled to a temporary file whenever more than
+        // max_memory bytes are buffered, and build() writes the header and
+        // the endpoints followed by the lists. The result is identical to
+        // freezing the index built by builder.
+        class stream_builder {
+        public:
+            stream_builder(uint64_t num_docs, global_parameters const& params,
+                           std::string const& output_filename,
+                           size_t max_memory)
+                : m_params(params)
+                , m_num_docs(num_docs)
+                , m_output_filename(output_filename)
+                , m_tmp_filename(output_filename + ".lists.tmp")
+                , m_max_memory(max_memory)
+                , m_flushed(0)
+            {
+                m_endpoints.push_back(0);
+                std::ofstream(m_tmp_filename.c_str(), std::ios::binary);
+            }
+
+            ~stream_builder()
+            {
+                std::remove(m_tmp_filename.c_str());
+            }
+
+            template <typename DocsIterator, typename FreqsIterator>
+            void add_posting_list(uint64_t n, DocsIterator docs_begin,
+                                  FreqsIterator freqs_begin, uint64_t /* occurrences */)
+            {
+                if (!n) throw std::invalid_argument("List must be nonempty");
+                block_posting_list<BlockCodec>::write(m_lists, n,
+                                                      docs_begin, freqs_begin);
+                m_endpoints.push_back(m_flushed + m_lists.size());
+                if (m_lists.size() > m_max_memory) {
+                    flush();
+                }
+            }
+
+            void build()
+            {
+                flush();
+
+                size_t size = m_endpoints.size() - 1;
+                uint64_t lists_size = m_flushed;
+                succinct::bit_vector_builder bvb;
+                compact_elias_fano::write(bvb, m_endpoints.begin(),
+                                          lists_size, size,
+                                          m_params); // XXX
+                succinct::bit_vector endpoints(&bvb);
+
+                std::ofstream fout(m_output_filename.c_str(), std::ios::binary);
+                // same sequence of fields as map(), followed by the data of
+                // m_lists
+                succinct::mapper::detail::freeze_visitor freezer(fout, 0);
+                freezer
+                    (m_params, "m_params")
+                    (size, "m_size")
+                    (m_num_docs, "m_num_docs")
+                    (endpoints, "m_endpoints")
+                    (lists_size, "size")
+                    ;
+
+                std::ifstream tmp(m_tmp_filename.c_str(), std::ios::binary);
+                std::vector<char> buf(1 << 20);
+                while (tmp.read(buf.data(), buf.size()) || tmp.gcount()) {
+                    fout.write(buf.data(), tmp.gcount());
+                }
+                if (!fout) {
+                    throw std::runtime_error("Error writing " + m_output_filename);
+                }
+            }
+
+        private:
+
+            void flush()
+            {
+                std::ofstream tmp(m_tmp_filename.c_str(),
+                                  std::ios::binary | std::ios::app);
+                tmp.write(reinterpret_cast<char const*>(m_lists.data()),
+                          m_lists.size());
+                if (!tmp) {
+                    throw std::runtime_error("Error writing " + m_tmp_filename);
+                }
+                m_flushed += m_lists.size();
+                m_lists.clear();
+            }
+
+            global_parameters m_params;
+            size_t m_num_docs;
+            std::string m_output_filename;
+            std::string m_tmp_filename;
+            size_t m_max_memory;
+            uint64_t m_flushed;
+            std::vector<uint64_t> m_endpoints;
+            std::vector<uint8_t> m_lists;
+        };
+
         size_t size() const
         {
             return m_size;
@@ -69,14 +174,66 @@ namespace quasi_succinct {
         document_enumerator operator[](size_t i) const
         {
             assert(i < size());
-            compact_elias_fano::enumerator endpoints(m_endpoints, 0,
-                                                     m_lists.size(), m_size,
-                                                     m_params);
-
-            auto endpoint = endpoints.move(i).second;
+            auto endpoint = list_endpoints().move(i).second;
             return document_enumerator(m_lists.data() + endpoint, num_docs());
         }
 
+        // Appends to out_enums the enumerators of the term ids in
+        // [begin, end), in the same order, as operator[] would, with a
+        // single forward pass over the endpoints and prefetching the
+        // beginning of each list before its header is parsed
+        template <typename TermIterator>
+        void lookup_batch(TermIterator begin, TermIterator end,
+                          std::vector<document_enumerator>& out_enums) const
+        {
+            auto endpoints = list_endpoints();
+            uint64_t pos[max_lookup_batch];
+            for_each_lookup_batch
+                (begin, end,
+                 [&](size_t i, uint64_t term) {
+                    assert(term < size());
+                    pos[i] = endpoints.move(term).second;
+                    m_lists.prefetch(pos[i]);
+                },
+                 [&](size_t i, uint64_t) {
+                    out_enums.push_back(document_enumerator(m_lists.data() + pos[i],
+                                                            num_docs()));
+                });
+        }
+
+        // Looks up the lists of the term ids in [begin, end) and prefetches
+        // the first two cache lines of each, which hold the block maxima
+        // and endpoints of the shorter lists, without building the
+        // enumerators
+        template <typename TermIterator>
+        void prefetch(TermIterator begin, TermIterator end) const
+        {
+            auto endpoints = list_endpoints();
+            for_each_lookup_batch
+                (begin, end,
+                 [&](size_t, uint64_t term) {
+                    assert(term < size());
+                    uint64_t pos = endpoints.move(term).second;
+                    m_lists.prefetch(pos);
+                    m_lists.prefetch(pos + 64);
+                },
+                 [](size_t, uint64_t) {});
+        }
+
+        // the i-th element is the position in lists() where the i-th list
+        // begins
+        compact_elias_fano::enumerator list_endpoints() const
+        {
+            return compact_elias_fano::enumerator(m_endpoints, 0,
+                                                  m_lists.size(), m_size,
+                                                  m_params);
+        }
+
+        succinct::mapper::mappable_vector<uint8_t> const& lists() const
+        {
+            return m_lists;
+        }
+
         void swap(block_freq_index& other)
         {
             std::swap(m_params, other.m_params);
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+
 #include "succinct/util.hpp"
 #include "block_codecs.hpp"
+#include "configuration.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -23,8 +26,10 @@ namespace quasi_succinct {
 
             DocsIterator docs_it(docs_begin);
             FreqsIterator freqs_it(freqs_begin);
-            std::vector<uint32_t> docs_buf(block_size);
-            std::vector<uint32_t> freqs_buf(block_size);
+            // on the stack, so that writing a list does not allocate
+            // besides growing out
+            uint32_t docs_buf[BlockCodec::block_size];
+            uint32_t freqs_buf[BlockCodec::block_size];
             uint32_t last_doc(-1);
             uint32_t block_base = 0;
             for (size_t b = 0; b < blocks; ++b) {
@@ -41,9 +46,9 @@ namespace quasi_succinct {
                 }
                 *((uint32_t*)&out[begin_block_maxs + 4 * b]) = last_doc;
 
-                BlockCodec::encode(docs_buf.data(), last_doc - block_base - (cur_block_size - 1),
+                BlockCodec::encode(docs_buf, last_doc - block_base - (cur_block_size - 1),
                                    cur_block_size, out);
-                BlockCodec::encode(freqs_buf.data(), uint32_t(-1), cur_block_size, out);
+                BlockCodec::encode(freqs_buf, uint32_t(-1), cur_block_size, out);
                 if (b != blocks - 1) {
                     *((uint32_t*)&out[begin_block_endpoints + 4 * b]) = out.size() - begin_blocks;
                 }
@@ -61,9 +66,8 @@ namespace quasi_succinct {
                 , m_block_endpoints(m_block_maxs + 4 * m_blocks)
                 , m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1))
                 , m_universe(universe)
+                , m_linear_scan_blocks(default_linear_scan_blocks())
             {
-                m_docs_buf.resize(BlockCodec::block_size);
-                m_freqs_buf.resize(BlockCodec::block_size);
                 reset();
             }
 
@@ -82,7 +86,7 @@ namespace quasi_succinct {
                     }
                     decode_docs_block(m_cur_block + 1);
                 } else {
-                    m_cur_docid += m_docs_buf[m_pos_in_block] + 1;
+                    m_cur_docid = m_docs_buf[m_pos_in_block];
                 }
             }
 
@@ -90,22 +94,17 @@ namespace quasi_succinct {
             {
                 assert(lower_bound >= m_cur_docid);
                 if (QS_UNLIKELY(lower_bound > m_cur_block_max)) {
-                    // binary search seems to perform worse here
                     if (lower_bound > block_max(m_blocks - 1)) {
                         m_cur_docid = m_universe;
                         return;
                     }
 
-                    uint64_t block = m_cur_block + 1;
-                    while (block_max(block) < lower_bound) {
-                        ++block;
-                    }
-
-                    decode_docs_block(block);
+                    decode_docs_block(find_block(lower_bound));
                 }
 
-                while (docid() < lower_bound) {
-                    m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
+                if (docid() < lower_bound) {
+                    m_pos_in_block = find_in_block(uint32_t(lower_bound));
+                    m_cur_docid = m_docs_buf[m_pos_in_block];
                     assert(m_pos_in_block < m_cur_block_size);
                 }
             }
@@ -117,9 +116,8 @@ namespace quasi_succinct {
                 if (QS_UNLIKELY(block != m_cur_block)) {
                     decode_docs_block(block);
                 }
-                while (position() < pos) {
-                    m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
-                }
+                m_pos_in_block = uint32_t(pos - block * BlockCodec::block_size);
+                m_cur_docid = m_docs_buf[m_pos_in_block];
             }
 
             uint64_t docid() const
@@ -145,6 +143,14 @@ namespace quasi_succinct {
                 return m_n;
             }
 
+            // Number of block maxima that next_geq scans linearly before
+            // switching to a galloping search; short skips are more common
+            // and a binary search performs worse on them
+            void set_linear_scan_blocks(uint32_t blocks)
+            {
+                m_linear_scan_blocks = blocks;
+            }
+
             uint64_t stats_freqs_size() const
             {
                 uint64_t bytes = 0;
@@ -170,11 +176,72 @@ namespace quasi_succinct {
             }
 
         private:
+            static uint32_t default_linear_scan_blocks()
+            {
+                static const uint32_t blocks =
+                    configuration::get().block_linear_scan;
+                return blocks;
+            }
+
             uint32_t block_max(uint32_t block) const
             {
                 return ((uint32_t const*)m_block_maxs)[block];
             }
 
+            // first block after the current one whose maximum is at least
+            // lower_bound, which must not exceed the last block maximum
+            uint64_t find_block(uint64_t lower_bound) const
+            {
+                uint64_t last = m_blocks - 1;
+                uint64_t block = m_cur_block + 1;
+                uint64_t linear_end = std::min(last, block + m_linear_scan_blocks);
+                while (block < linear_end && block_max(block) < lower_bound) {
+                    ++block;
+                }
+                if (block_max(block) >= lower_bound) {
+                    return block;
+                }
+
+                // gallop until a maximum is not smaller than lower_bound,
+                // then binary search the last step
+                uint64_t lo = block;
+                uint64_t step = 1;
+                uint64_t hi = lo + step;
+                while (hi < last && block_max(hi) < lower_bound) {
+                    lo = hi;
+                    step *= 2;
+                    hi = lo + step;
+                }
+                hi = std::min(hi, last);
+
+                uint32_t const* maxs = (uint32_t const*)m_block_maxs;
+                return std::lower_bound(maxs + lo + 1, maxs + hi,
+                                        lower_bound) - maxs;
+            }
+
+            // first position in the current block, not before the current
+            // one, whose docid is at least lower_bound, which must not
+            // exceed the block maximum. The docids are compared four at a
+            // time; the lanes before the current position are smaller, and
+            // the ones past the end of the block are after the maximum.
+            uint32_t QS_ALWAYSINLINE find_in_block(uint32_t lower_bound) const
+            {
+                // unsigned comparison through the signed one
+                const __m128i sign = _mm_set1_epi32(int(0x80000000U));
+                __m128i lb = _mm_xor_si128(_mm_set1_epi32(int(lower_bound)), sign);
+                uint32_t pos = m_pos_in_block & ~3U;
+                while (true) {
+                    __m128i docs = _mm_load_si128(
+                        reinterpret_cast<__m128i const*>(m_docs_buf + pos));
+                    int smaller = _mm_movemask_ps(_mm_castsi128_ps(
+                        _mm_cmplt_epi32(_mm_xor_si128(docs, sign), lb)));
+                    if (smaller != 0xF) {
+                        return pos + __builtin_ctz(~smaller);
+                    }
+                    pos += 4;
+                }
+            }
+
             void QS_NOINLINE decode_docs_block(uint64_t block)
             {
                 static const uint64_t block_size = BlockCodec::block_size;
@@ -187,12 +254,11 @@ namespace quasi_succinct {
                     ? block_size : (size() % block_size);
                 uint32_t cur_base = (block ? block_max(block - 1) : uint32_t(-1)) + 1;
                 m_cur_block_max = block_max(block);
+                // the docids are reconstructed while decoding
                 m_freqs_block_data =
-                    BlockCodec::decode(block_data, m_docs_buf.data(),
-                                       m_cur_block_max - cur_base - (m_cur_block_size - 1),
-                                       m_cur_block_size);
-
-                m_docs_buf[0] += cur_base;
+                    block_decode_docs<BlockCodec>(block_data, m_docs_buf,
+                                                  m_cur_block_max - cur_base - (m_cur_block_size - 1),
+                                                  m_cur_block_size, cur_base);
 
                 m_cur_block = block;
                 m_pos_in_block = 0;
@@ -202,7 +268,7 @@ namespace quasi_succinct {
 
             void QS_NOINLINE decode_freqs_block()
             {
-                BlockCodec::decode(m_freqs_block_data, m_freqs_buf.data(),
+                BlockCodec::decode(m_freqs_block_data, m_freqs_buf,
                                    uint32_t(-1), m_cur_block_size);
                 m_freqs_decoded = true;
             }
@@ -214,6 +280,7 @@ namespace quasi_succinct {
             uint8_t const* m_block_endpoints;
             uint8_t const* m_blocks_data;
             uint64_t m_universe;
+            uint32_t m_linear_scan_blocks;
 
             uint32_t m_cur_block;
             uint32_t m_pos_in_block;
@@ -224,8 +291,11 @@ namespace quasi_succinct {
             uint8_t const* m_freqs_block_data;
             bool m_freqs_decoded;
 
-            std::vector<uint32_t> m_docs_buf;
-            std::vector<uint32_t> m_freqs_buf;
+            // inline rather than heap-allocated, so that creating (one per
+            // query term) and copying the enumerators does not allocate.
+            // m_docs_buf holds the docids of the current block, not the gaps
+            alignas(16) uint32_t m_docs_buf[BlockCodec::block_size];
+            alignas(16) uint32_t m_freqs_buf[BlockCodec::block_size];
         };
 
     };
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Wraps an index and caches the enumerators of the recently accessed
+    // terms, so that operator[] on a cached term copies a prototype
+    // enumerator instead of looking up the endpoints and parsing the list
+    // header and partition metadata. It has the interface used by the
+    // query operators, so it can be passed in place of the index.
+    //
+    // The cache is set-associative, with CLOCK replacement within each
+    // set, and can be shared among threads. Lookups do not lock: each slot
+    // has a sequence number which is odd while the slot is being written,
+    // and a lookup that sees it change discards the copy and counts a
+    // miss. Inserts are serialized, and skipped when another thread is
+    // inserting. The copy is a memcpy, so the document_enumerator must be
+    // trivially copyable, which is the case for all the index types.
+    template <typename Index>
+    class cached_index {
+    public:
+        typedef typename Index::document_enumerator document_enumerator;
+
+        static const size_t ways = 4;
+
+        cached_index(Index const& index, size_t capacity)
+            : m_index(index)
+            , m_set_mask(0)
+            , m_hits(0)
+            , m_misses(0)
+        {
+            size_t sets = 0;
+            if (capacity) {
+                sets = 1;
+                while (sets * ways < capacity) sets *= 2;
+                m_set_mask = sets - 1;
+            }
+            m_slots.reset(new slot[sets * ways]);
+            m_hands.resize(sets);
+            for (size_t i = 0; i < sets * ways; ++i) {
+                m_slots[i].version = 0;
+                m_slots[i].term = 0;
+                m_slots[i].referenced = false;
+            }
+        }
+
+        uint64_t size() const
+        {
+            return m_index.size();
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_index.num_docs();
+        }
+
+        size_t capacity() const
+        {
+            return m_hands.size() * ways;
+        }
+
+        document_enumerator operator[](size_t term) const
+        {
+            if (!capacity()) {
+                return m_index[term];
+            }
+
+            slot* set = &m_slots[(term & m_set_mask) * ways];
+            for (size_t w = 0; w < ways; ++w) {
+                slot& s = set[w];
+                uint64_t version = s.version.load(std::memory_order_acquire);
+                if ((version & 1) ||
+                    s.term.load(std::memory_order_relaxed) != term + 1) {
+                    continue;
+                }
+                storage_type data;
+                std::memcpy(&data, &s.data, sizeof(data));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (s.version.load(std::memory_order_relaxed) != version) {
+                    continue;
+                }
+
+                if (!s.referenced.load(std::memory_order_relaxed)) {
+                    s.referenced.store(true, std::memory_order_relaxed);
+                }
+                m_hits.fetch_add(1, std::memory_order_relaxed);
+                return reinterpret_cast<document_enumerator const&>(data);
+            }
+
+            m_misses.fetch_add(1, std::memory_order_relaxed);
+            document_enumerator e = m_index[term];
+            insert(term, e);
+            return e;
+        }
+
+        template <typename TermIterator>
+        void lookup_batch(TermIterator begin, TermIterator end,
+                          std::vector<document_enumerator>& out_enums) const
+        {
+            for (; begin != end; ++begin) {
+                out_enums.push_back((*this)[batch_term_id(*begin)]);
+            }
+        }
+
+        template <typename TermIterator>
+        void prefetch(TermIterator begin, TermIterator end) const
+        {
+            m_index.prefetch(begin, end);
+        }
+
+        uint64_t hits() const
+        {
+            return m_hits;
+        }
+
+        uint64_t misses() const
+        {
+            return m_misses;
+        }
+
+        void reset_stats()
+        {
+            m_hits = 0;
+            m_misses = 0;
+        }
+
+    private:
+        typedef typename std::aligned_storage<sizeof(document_enumerator),
+                                              alignof(document_enumerator)>::type
+            storage_type;
+
+        struct slot {
+            std::atomic<uint64_t> version;
+            std::atomic<uint64_t> term; // term id + 1, 0 if empty
+            std::atomic<bool> referenced;
+            storage_type data;
+        };
+
+        void insert(size_t term, document_enumerator const& e) const
+        {
+            std::unique_lock<std::mutex> lock(m_insert_mutex, std::try_to_lock);
+            if (!lock.owns_lock()) return;
+
+            size_t set_idx = term & m_set_mask;
+            slot* set = &m_slots[set_idx * ways];
+            for (size_t w = 0; w < ways; ++w) {
+                // inserted by another thread after our lookup
+                if (set[w].term.load(std::memory_order_relaxed) == term + 1) return;
+            }
+
+            // the first slot not referenced since the hand last passed it
+            uint8_t& hand = m_hands[set_idx];
+            slot* victim;
+            while (true) {
+                victim = &set[hand];
+                hand = (hand + 1) % ways;
+                if (!victim->referenced.load(std::memory_order_relaxed)) break;
+                victim->referenced.store(false, std::memory_order_relaxed);
+            }
+
+            uint64_t version = victim->version.load(std::memory_order_relaxed);
+            victim->version.store(version + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            victim->term.store(term + 1, std::memory_order_relaxed);
+            std::memcpy(&victim->data, &e, sizeof(e));
+            victim->referenced.store(true, std::memory_order_relaxed);
+            victim->version.store(version + 2, std::memory_order_release);
+        }
+
+        Index const& m_index;
+        size_t m_set_mask;
+        std::unique_ptr<slot[]> m_slots;
+        mutable std::vector<uint8_t> m_hands; // protected by m_insert_mutex
+        mutable std::mutex m_insert_mutex;
+        mutable std::atomic<uint64_t> m_hits;
+        mutable std::atomic<uint64_t> m_misses;
+    };
+
+}
@@ -258,6 +258,27 @@ namespace quasi_succinct {
                 return m_position;
             }
 
+            // Decodes the values in [position, position + count) into out
+            // and leaves the enumerator on the last one. After the initial
+            // move the loop reads the high and low bits directly, with no
+            // end-of-sequence checks; values must fit in 32 bits.
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+                assert(m_of.universe <= (uint64_t(1) << 32));
+
+                move(position);
+                out[0] = uint32_t(m_value);
+                if (count > 1) {
+                    next_reader read_value(*this, position + 1);
+                    for (uint64_t i = 1; i < count; ++i) {
+                        out[i] = uint32_t(read_value());
+                    }
+                }
+                m_position = position + count - 1;
+                m_value = out[count - 1];
+            }
+
         private:
 
             value_type QS_NOINLINE slow_move(uint64_t position)
@@ -221,6 +221,24 @@ namespace quasi_succinct {
                 return pos - m_of.bits_offset;
             }
 
+            // Decodes the values in [position, position + count) into out
+            // and leaves the enumerator on the last one.
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+                assert(m_of.universe <= (uint64_t(1) << 32));
+
+                move(position);
+                out[0] = uint32_t(m_value);
+                succinct::bit_vector::unary_enumerator he = m_enumerator;
+                for (uint64_t i = 1; i < count; ++i) {
+                    out[i] = uint32_t(he.next() - m_of.bits_offset);
+                }
+                m_enumerator = he;
+                m_position = position + count - 1;
+                m_value = out[count - 1];
+            }
+
         private:
 
             value_type QS_NOINLINE slow_move(uint64_t position)
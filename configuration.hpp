@@ -2,6 +2,7 @@
 
 #include <cstdlib>
 #include <cstdint>
+#include <string>
 #include <thread>
 #include <boost/lexical_cast.hpp>
 
@@ -17,9 +18,28 @@ namespace quasi_succinct {
         double eps1;
         double eps2;
         uint64_t fix_cost;
+        double speed_lambda;
+        uint64_t partition_chunk_size;
 
         size_t log_partition_size;
         size_t worker_threads;
+        size_t build_memory_mb;
+        size_t query_threads;
+        size_t query_shards;
+        size_t term_cache_size;
+        size_t query_prefetch_depth;
+        std::string load_mode;
+        std::string numa_mode;
+        size_t list_cache_mb;
+        size_t warmup_threads;
+        std::string hot_terms_file;
+        std::string record_hot_terms_file;
+        bool use_io_uring;
+        uint32_t block_linear_scan;
+        size_t bench_runs;
+
+        size_t wand_block_size;
+        float wand_block_lambda;
 
     private:
         configuration()
@@ -27,8 +47,26 @@ namespace quasi_succinct {
             fillvar("QS_EPS1", eps1, 0.03);
             fillvar("QS_EPS2", eps2, 0.3);
             fillvar("QS_FIXCOST", fix_cost, 64);
+            fillvar("QS_SPEED_LAMBDA", speed_lambda, 0);
+            fillvar("QS_PARTITION_CHUNK", partition_chunk_size, 0);
             fillvar("QS_LOG_PART", log_partition_size, 7);
             fillvar("QS_THREADS", worker_threads, std::thread::hardware_concurrency());
+            fillvar("QS_BUILD_MEMORY", build_memory_mb, 0);
+            fillvar("QS_QUERY_THREADS", query_threads, 0);
+            fillvar("QS_QUERY_SHARDS", query_shards, 0);
+            fillvar("QS_TERM_CACHE", term_cache_size, 0);
+            fillvar("QS_QUERY_PREFETCH", query_prefetch_depth, 0);
+            fillvar("QS_LOAD_MODE", load_mode, "mmap");
+            fillvar("QS_NUMA_MODE", numa_mode, "none");
+            fillvar("QS_LIST_CACHE", list_cache_mb, 1024);
+            fillvar("QS_IO_URING", use_io_uring, true);
+            fillvar("QS_WARMUP_THREADS", warmup_threads, std::thread::hardware_concurrency());
+            fillvar("QS_HOT_TERMS", hot_terms_file, "");
+            fillvar("QS_RECORD_HOT_TERMS", record_hot_terms_file, "");
+            fillvar("QS_BLOCK_LINEAR_SCAN", block_linear_scan, 16);
+            fillvar("QS_BENCH_RUNS", bench_runs, 0);
+            fillvar("QS_WAND_BLOCK_SIZE", wand_block_size, 64);
+            fillvar("QS_WAND_LAMBDA", wand_block_lambda, 0);
         }
 
         template <typename T, typename T2>
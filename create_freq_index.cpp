@@ -129,8 +129,15 @@ void dump_index_specific_stats(quasi_succinct::uniform_index const& coll,
 }
 
 
-void dump_index_specific_stats(quasi_succinct::opt_index const& coll,
-                               std::string const& type)
+// opt_index and opt_bitpacked_index
+template <typename BaseSequence>
+void dump_index_specific_stats(
+    quasi_succinct::freq_index<
+        quasi_succinct::partitioned_sequence<BaseSequence>,
+        quasi_succinct::positive_sequence<
+            quasi_succinct::partitioned_sequence<quasi_succinct::strict_sequence>>
+    > const& coll,
+    std::string const& type)
 {
     auto const& conf = quasi_succinct::configuration::get();
 
@@ -153,12 +160,53 @@ void dump_index_specific_stats(quasi_succinct::opt_index const& coll,
         ("eps1", conf.eps1)
         ("eps2", conf.eps2)
         ("fix_cost", conf.fix_cost)
+        ("speed_lambda", conf.speed_lambda)
         ("docs_avg_part", long_postings / docs_partitions)
         ("freqs_avg_part", long_postings / freqs_partitions)
         ;
+
+    auto const& chunked = quasi_succinct::chunked_partition_stats::get();
+    if (chunked.lists) {
+        double chunked_eps = double(chunked.boundary_cost) / double(chunked.cost);
+        logger() << chunked.lists << " sequences partitioned in chunks of "
+                 << conf.partition_chunk_size << ", estimated cost overhead "
+                 << chunked_eps << std::endl;
+        quasi_succinct::stats_line()
+            ("type", type)
+            ("partition_chunk_size", conf.partition_chunk_size)
+            ("chunked_sequences", uint64_t(chunked.lists))
+            ("chunk_boundaries", uint64_t(chunked.boundaries))
+            ("kept_chunk_boundaries", uint64_t(chunked.kept_boundaries))
+            ("chunked_eps", chunked_eps)
+            ;
+    }
 }
 
 
+template <typename Builder>
+auto dump_builder_stats(Builder const& builder, std::string const& type, int)
+    -> decltype(builder.pool(), void())
+{
+    auto const& pool = builder.pool();
+    logger() << "Worker threads were busy "
+             << pool.utilization() * 100 << "% of the time" << std::endl;
+
+    quasi_succinct::stats_line()
+        ("type", type)
+        ("worker_threads", pool.threads())
+        ("worker_utilization", pool.utilization())
+        ("worker_steals", pool.steals())
+        ("max_reorder_size", pool.max_reorder_size())
+        ("add_stall_time", pool.stall_time_usecs() / 1000000)
+        ;
+}
+
+// builders that do not use a job_pool have nothing to report
+template <typename Builder>
+void dump_builder_stats(Builder const&, std::string const&, long)
+{}
+
+
 struct progress_logger {
     progress_logger()
         : sequences(0)
@@ -183,20 +231,10 @@ struct progress_logger {
     size_t sequences, postings;
 };
 
-template <typename InputCollection, typename CollectionType>
-void create_collection(InputCollection const& input,
-                       quasi_succinct::global_parameters const& params,
-                       const char* output_filename, bool check,
-                       std::string const& seq_type)
+template <typename InputCollection, typename Builder>
+void add_posting_lists(InputCollection const& input, Builder& builder,
+                       progress_logger& plog)
 {
-    using namespace quasi_succinct;
-
-    logger() << "Processing " << input.num_docs() << " documents" << std::endl;
-    double tick = get_time_usecs();
-    double user_tick = get_user_time_usecs();
-
-    typename CollectionType::builder builder(input.num_docs(), params);
-    progress_logger plog;
     for (auto const& plist: input) {
         uint64_t freqs_sum = std::accumulate(plist.freqs.begin(),
                                              plist.freqs.end(), uint64_t(0));
@@ -205,10 +243,15 @@ void create_collection(InputCollection const& input,
                                  plist.freqs.begin(), freqs_sum);
         plog.done_sequence(plist.docs.size());
     }
-
     plog.log();
-    CollectionType coll;
-    builder.build(coll);
+}
+
+template <typename Builder>
+void dump_construction_stats(Builder const& builder, std::string const& seq_type,
+                             double tick, double user_tick)
+{
+    using namespace quasi_succinct;
+
     double elapsed_secs = (get_time_usecs() - tick) / 1000000;
     double user_elapsed_secs = (get_user_time_usecs() - user_tick) / 1000000;
     logger() << seq_type << " collection built in "
@@ -220,12 +263,54 @@ void create_collection(InputCollection const& input,
         ("construction_time", elapsed_secs)
         ("construction_user_time", user_elapsed_secs)
         ;
+    dump_builder_stats(builder, seq_type, 0);
+}
+
+template <typename InputCollection, typename CollectionType>
+void create_collection(InputCollection const& input,
+                       quasi_succinct::global_parameters const& params,
+                       const char* output_filename, bool check,
+                       std::string const& seq_type)
+{
+    using namespace quasi_succinct;
+
+    logger() << "Processing " << input.num_docs() << " documents" << std::endl;
+    double tick = get_time_usecs();
+    double user_tick = get_user_time_usecs();
+
+    size_t build_memory_mb = configuration::get().build_memory_mb;
+    bool streaming = output_filename && build_memory_mb;
+
+    progress_logger plog;
+    CollectionType coll;
+    boost::iostreams::mapped_file_source m;
+    if (streaming) {
+        logger() << "Writing the index while building it, buffering at most "
+                 << build_memory_mb << " MB" << std::endl;
+        typename CollectionType::stream_builder
+            builder(input.num_docs(), params, output_filename,
+                    build_memory_mb << 20);
+        add_posting_lists(input, builder, plog);
+        builder.build();
+        dump_construction_stats(builder, seq_type, tick, user_tick);
+
+        // the statistics are computed on the written index
+        m.open(output_filename);
+        succinct::mapper::map(coll, m);
+    } else {
+        typename CollectionType::builder builder(input.num_docs(), params);
+        add_posting_lists(input, builder, plog);
+        builder.build(coll);
+        dump_construction_stats(builder, seq_type, tick, user_tick);
+    }
 
     dump_stats(coll, seq_type, plog.postings);
     dump_index_specific_stats(coll, seq_type);
 
     if (output_filename) {
-        succinct::mapper::freeze(coll, output_filename);
+        if (!streaming) {
+            succinct::mapper::freeze(coll, output_filename);
+        }
         if (check) {
             verify_collection<InputCollection, CollectionType>(input, output_filename);
         }
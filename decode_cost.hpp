@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include "succinct/broadword.hpp"
+
+namespace quasi_succinct {
+
+    // A model of the time to decode a sequence with next(), used to trade
+    // space for speed when choosing the encoding of a sequence or of a
+    // partition. The nanoseconds per element are tabulated for each
+    // encoding at the average gaps 1, 2, 4, ..., 256, and interpolated
+    // linearly in between. The tables come from the calibration of
+    // bench_sequences on sequences of 4096 elements.
+    struct decode_cost {
+
+        enum encoding {
+            elias_fano = 0,
+            ranked_bitvector = 1,
+            all_ones = 2,
+            bitpacked = 3,
+
+            encodings = 4
+        };
+
+        static const size_t max_log_gap = 8;
+
+        static double ns_per_element(encoding e, uint64_t universe, uint64_t n)
+        {
+            // the all_ones enumerator only increments a counter, which
+            // the calibration loop optimizes away; the cost of the loop
+            // itself is charged instead
+            static const double table[encodings][max_log_gap + 1] = {
+                { 4.4, 5.3, 6.2, 6.2, 6.2, 6.1, 6.2, 6.2, 6.1 },
+                { 2.0, 2.3, 2.7, 3.4, 4.9, 7.2, 10.6, 16.0, 21.1 },
+                { 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5 },
+                { 3.2, 3.3, 3.7, 3.4, 3.9, 3.8, 3.9, 3.6, 4.0 },
+            };
+
+            if (!n || universe <= n) return table[e][0];
+            if (universe >= (n << max_log_gap)) return table[e][max_log_gap];
+            double gap = double(universe) / double(n);
+            size_t i = succinct::broadword::msb(uint64_t(gap));
+            double frac = gap / double(uint64_t(1) << i) - 1;
+            return table[e][i] * (1 - frac) + table[e][i + 1] * frac;
+        }
+
+        // lambda times the decoding time of the sequence in nanoseconds,
+        // in the same unit as the size in bits
+        static uint64_t cost(encoding e, uint64_t universe, uint64_t n, double lambda)
+        {
+            if (lambda == 0) return 0;
+            return uint64_t(lambda * double(n) * ns_per_element(e, universe, n) + 0.5);
+        }
+    };
+}
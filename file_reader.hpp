@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace quasi_succinct {
+
+    // Reads byte ranges of a file into memory, submitting each batch of
+    // reads at once through io_uring, so that the reads of a batch are
+    // served in parallel by the device. io_uring is used through its
+    // system calls, without liburing; when the kernel does not support it
+    // (or it is disabled) the reads are done with pread, one at a time.
+    class file_reader {
+    public:
+        struct request {
+            void* buf;
+            size_t len;
+            uint64_t offset;
+        };
+
+        file_reader(const char* filename, bool use_io_uring = true)
+            : m_use_io_uring(use_io_uring)
+        {
+            m_fd = ::open(filename, O_RDONLY);
+            if (m_fd < 0) {
+                throw std::runtime_error(std::string("Cannot open ") + filename
+                                         + ": " + std::strerror(errno));
+            }
+            if (m_use_io_uring && !thread_ring()) {
+                m_use_io_uring = false;
+            }
+        }
+
+        ~file_reader()
+        {
+            ::close(m_fd);
+        }
+
+        bool uses_io_uring() const
+        {
+            return m_use_io_uring;
+        }
+
+        // returns when all the n requests are complete
+        void read(request const* reqs, size_t n) const
+        {
+            io_ring* ring = m_use_io_uring ? thread_ring() : nullptr;
+            if (ring) {
+                ring->read(m_fd, reqs, n);
+            } else {
+                for (size_t i = 0; i < n; ++i) {
+                    read_fully(m_fd, reqs[i], 0);
+                }
+            }
+        }
+
+    private:
+        file_reader(file_reader const&);
+        file_reader& operator=(file_reader const&);
+
+        static void read_fully(int fd, request const& req, size_t done)
+        {
+            char* buf = static_cast<char*>(req.buf);
+            while (done < req.len) {
+                ssize_t ret = pread(fd, buf + done, req.len - done, req.offset + done);
+                if (ret < 0 && errno == EINTR) continue;
+                if (ret <= 0) {
+                    throw std::runtime_error(std::string("Read error: ")
+                                             + std::strerror(ret ? errno : EIO));
+                }
+                done += ret;
+            }
+        }
+
+        // An io_uring instance with its submission and completion rings.
+        // A ring is not thread-safe, so each thread has its own, shared by
+        // all the readers since the file descriptor is given per request
+        class io_ring {
+        public:
+            static const unsigned entries = 64;
+
+            io_ring()
+                : m_fd(-1)
+                , m_ok(false)
+                , m_sq_ring(MAP_FAILED)
+                , m_cq_ring(MAP_FAILED)
+                , m_sqes(MAP_FAILED)
+            {
+                io_uring_params p;
+                std::memset(&p, 0, sizeof(p));
+                m_fd = int(syscall(__NR_io_uring_setup, entries, &p));
+                if (m_fd < 0) return;
+
+                m_sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+                m_cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+                m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+                m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+                m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                m_sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+                if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED ||
+                    m_sqes == MAP_FAILED) {
+                    return;
+                }
+
+                char* sq = static_cast<char*>(m_sq_ring);
+                m_sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+                m_sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+                m_sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+                char* cq = static_cast<char*>(m_cq_ring);
+                m_cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+                m_cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+                m_cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+                m_cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+                m_ok = true;
+            }
+
+            ~io_ring()
+            {
+                if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_size);
+                if (m_cq_ring != MAP_FAILED) munmap(m_cq_ring, m_cq_ring_size);
+                if (m_sq_ring != MAP_FAILED) munmap(m_sq_ring, m_sq_ring_size);
+                if (m_fd >= 0) ::close(m_fd);
+            }
+
+            bool ok() const
+            {
+                return m_ok;
+            }
+
+            void read(int fd, request const* reqs, size_t n)
+            {
+                io_uring_sqe* sqes = static_cast<io_uring_sqe*>(m_sqes);
+                for (size_t begin = 0; begin < n; begin += entries) {
+                    unsigned count = unsigned(std::min<size_t>(n - begin, entries));
+                    unsigned tail = *m_sq_tail;
+                    for (unsigned i = 0; i < count; ++i, ++tail) {
+                        request const& req = reqs[begin + i];
+                        unsigned idx = tail & m_sq_mask;
+                        io_uring_sqe& sqe = sqes[idx];
+                        std::memset(&sqe, 0, sizeof(sqe));
+                        sqe.opcode = IORING_OP_READ;
+                        sqe.fd = fd;
+                        sqe.addr = reinterpret_cast<uint64_t>(req.buf);
+                        sqe.len = unsigned(req.len);
+                        sqe.off = req.offset;
+                        sqe.user_data = begin + i;
+                        m_sq_array[idx] = idx;
+                    }
+                    __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+                    unsigned submitted = 0, completed = 0;
+                    while (completed < count) {
+                        long ret = syscall(__NR_io_uring_enter, m_fd,
+                                           count - submitted, count - completed,
+                                           IORING_ENTER_GETEVENTS, nullptr, 0);
+                        if (ret < 0) {
+                            if (errno == EINTR) continue;
+                            throw std::runtime_error(std::string("io_uring_enter: ")
+                                                     + std::strerror(errno));
+                        }
+                        submitted += unsigned(ret);
+
+                        unsigned head = *m_cq_head;
+                        unsigned cq_tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+                        for (; head != cq_tail; ++head, ++completed) {
+                            io_uring_cqe const& cqe = m_cqes[head & m_cq_mask];
+                            request const& req = reqs[cqe.user_data];
+                            if (cqe.res < 0) {
+                                throw std::runtime_error(std::string("Read error: ")
+                                                         + std::strerror(-cqe.res));
+                            }
+                            // short reads are rare, finish them synchronously
+                            if (size_t(cqe.res) < req.len) {
+                                read_fully(fd, req, cqe.res);
+                            }
+                        }
+                        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+                    }
+                }
+            }
+
+        private:
+            int m_fd;
+            bool m_ok;
+            void* m_sq_ring;
+            void* m_cq_ring;
+            void* m_sqes;
+            size_t m_sq_ring_size, m_cq_ring_size, m_sqes_size;
+            unsigned* m_sq_tail;
+            unsigned m_sq_mask;
+            unsigned* m_sq_array;
+            unsigned* m_cq_head;
+            unsigned* m_cq_tail;
+            unsigned m_cq_mask;
+            io_uring_cqe* m_cqes;
+        };
+
+        // the ring of the calling thread, null if io_uring is not available
+        static io_ring* thread_ring()
+        {
+            static thread_local std::unique_ptr<io_ring> ring;
+            static std::atomic<bool> unsupported(false);
+            if (!ring && !unsupported) {
+                ring.reset(new io_ring());
+                if (!ring->ok()) {
+                    unsupported = true;
+                }
+            }
+            return unsupported ? nullptr : ring.get();
+        }
+
+        int m_fd;
+        bool m_use_io_uring;
+    };
+
+}
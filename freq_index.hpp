@@ -4,7 +4,10 @@
 #include "compact_elias_fano.hpp"
 #include "integer_codes.hpp"
 #include "global_parameters.hpp"
-#include "semiasync_queue.hpp"
+#include "job_pool.hpp"
+#include "util.hpp"
+
+#include <succinct/mapper.hpp>
 
 namespace quasi_succinct {
 
@@ -15,16 +18,13 @@ namespace quasi_succinct {
             : m_num_docs(0)
         {}
 
-        class builder {
-        public:
-            builder(uint64_t num_docs, global_parameters const& params)
-                : m_queue(1 << 24)
-                , m_params(params)
-                , m_num_docs(num_docs)
-                , m_docs_sequences(params)
-                , m_freqs_sequences(params)
-            {}
+    private:
 
+        // Shared by builder and stream_builder, which differ only in where
+        // the encoded lists are collected
+        template <typename SequencesBuilder>
+        class builder_base {
+        public:
             template <typename DocsIterator, typename FreqsIterator>
             void add_posting_list(uint64_t n, DocsIterator docs_begin,
                                   FreqsIterator freqs_begin, uint64_t occurrences)
@@ -39,21 +39,27 @@ namespace quasi_succinct {
                 m_queue.add_job(ptr, 2 * n);
             }
 
-            void build(freq_index& sq)
+            job_pool const& pool() const
             {
-                m_queue.complete();
-                sq.m_num_docs = m_num_docs;
-                sq.m_params = m_params;
-
-                m_docs_sequences.build(sq.m_docs_sequences);
-                m_freqs_sequences.build(sq.m_freqs_sequences);
+                return m_queue;
             }
 
-        private:
+        protected:
+
+            builder_base(uint64_t num_docs, global_parameters const& params,
+                         double work_per_thread,
+                         SequencesBuilder* docs_sequences,
+                         SequencesBuilder* freqs_sequences)
+                : m_queue(work_per_thread)
+                , m_params(params)
+                , m_num_docs(num_docs)
+                , m_docs_sequences(docs_sequences)
+                , m_freqs_sequences(freqs_sequences)
+            {}
 
             template <typename DocsIterator, typename FreqsIterator>
-            struct list_adder : semiasync_queue::job {
-                list_adder(builder& b,
+            struct list_adder : job_pool::job {
+                list_adder(builder_base& b,
                            DocsIterator docs_begin,
                            FreqsIterator freqs_begin,
                            uint64_t occurrences,
@@ -83,11 +89,11 @@ namespace quasi_succinct {
 
                 virtual void commit()
                 {
-                    b.m_docs_sequences.append(docs_bits);
-                    b.m_freqs_sequences.append(freqs_bits);
+                    b.m_docs_sequences->append(docs_bits);
+                    b.m_freqs_sequences->append(freqs_bits);
                 }
 
-                builder& b;
+                builder_base& b;
                 DocsIterator docs_begin;
                 FreqsIterator freqs_begin;
                 uint64_t occurrences;
@@ -96,11 +102,103 @@ namespace quasi_succinct {
                 succinct::bit_vector_builder freqs_bits;
             };
 
-            semiasync_queue m_queue;
+            job_pool m_queue;
             global_parameters m_params;
             uint64_t m_num_docs;
-            bitvector_collection::builder m_docs_sequences;
-            bitvector_collection::builder m_freqs_sequences;
+            // owned by the derived class, which is constructed after
+            // builder_base
+            SequencesBuilder* m_docs_sequences;
+            SequencesBuilder* m_freqs_sequences;
+        };
+
+    public:
+
+        class builder : public builder_base<bitvector_collection::builder> {
+        public:
+            builder(uint64_t num_docs, global_parameters const& params)
+                : builder_base<bitvector_collection::builder>
+                  (num_docs, params, 1 << 24, &m_docs, &m_freqs)
+                , m_docs(params)
+                , m_freqs(params)
+            {}
+
+            ~builder()
+            {
+                // the pending jobs commit into m_docs and m_freqs
+                this->m_queue.complete();
+            }
+
+            void build(freq_index& sq)
+            {
+                this->m_queue.complete();
+                sq.m_num_docs = this->m_num_docs;
+                sq.m_params = this->m_params;
+
+                m_docs.build(sq.m_docs_sequences);
+                m_freqs.build(sq.m_freqs_sequences);
+            }
+
+        private:
+            bitvector_collection::builder m_docs;
+            bitvector_collection::builder m_freqs;
+        };
+
+        // Writes the index to output_filename while it is being built:
+        // the encoded lists are buffered in memory up to max_memory bytes
+        // and then spilled to temporary files next to the output, which
+        // are copied into place by build() after the header and the
+        // endpoints. The result is identical to freezing the index built
+        // by builder.
+        class stream_builder
+            : public builder_base<bitvector_collection::stream_builder> {
+        public:
+            stream_builder(uint64_t num_docs, global_parameters const& params,
+                           std::string const& output_filename,
+                           size_t max_memory)
+                : builder_base<bitvector_collection::stream_builder>
+                  (num_docs, params, work_per_thread(max_memory), &m_docs, &m_freqs)
+                , m_output_filename(output_filename)
+                , m_docs(params, output_filename + ".docs.tmp", max_memory / 4)
+                , m_freqs(params, output_filename + ".freqs.tmp", max_memory / 4)
+            {}
+
+            ~stream_builder()
+            {
+                this->m_queue.complete();
+            }
+
+            void build()
+            {
+                this->m_queue.complete();
+
+                std::ofstream fout(m_output_filename.c_str(), std::ios::binary);
+                // the flags argument is required for succinct to write the
+                // same header as mapper::freeze
+                succinct::mapper::detail::freeze_visitor freezer(fout, 0);
+                freezer
+                    (this->m_params, "m_params")
+                    (this->m_num_docs, "m_num_docs")
+                    ;
+                m_docs.freeze(freezer, fout);
+                m_freqs.freeze(freezer, fout);
+                if (!fout) {
+                    throw std::runtime_error("Error writing " + m_output_filename);
+                }
+            }
+
+        private:
+            // half of the memory goes to the lists that are being encoded;
+            // each unit of work (two per posting) takes about 16 bytes
+            static double work_per_thread(size_t max_memory)
+            {
+                size_t threads = std::max<size_t>(1, configuration::get().worker_threads);
+                return std::min(double(1 << 24),
+                                std::max(1.0, double(max_memory) / 2 / 16 / threads));
+            }
+
+            std::string m_output_filename;
+            bitvector_collection::stream_builder m_docs;
+            bitvector_collection::stream_builder m_freqs;
         };
 
         uint64_t size() const
@@ -142,6 +240,20 @@ namespace quasi_succinct {
                 m_cur_docid = val.second;
             }
 
+            // Decodes up to max_count docids starting from the current one
+            // into out, moves past them, and returns how many were written
+            // (0 once the list is exhausted).
+            uint64_t QS_FLATTEN_FUNC next_batch(uint32_t* out, uint64_t max_count)
+            {
+                uint64_t count = std::min(max_count, size() - m_cur_pos);
+                if (!count) {
+                    return 0;
+                }
+                m_docs_enum.decode_range(m_cur_pos, count, out);
+                next();
+                return count;
+            }
+
             uint64_t docid() const
             {
                 return m_cur_docid;
@@ -192,21 +304,100 @@ namespace quasi_succinct {
         document_enumerator operator[](size_t i) const
         {
             assert(i < size());
-            auto docs_it = m_docs_sequences.get(m_params, i);
+            return make_enumerator(m_docs_sequences.bits(),
+                                   m_docs_sequences.get(m_params, i).position(),
+                                   m_freqs_sequences.bits(),
+                                   m_freqs_sequences.get(m_params, i).position());
+        }
+
+        // Appends to out_enums the enumerators of the term ids in
+        // [begin, end), in the same order, as operator[] would. The
+        // endpoints are looked up in increasing term order with a single
+        // forward pass over each endpoints sequence, and the beginning of
+        // every list is prefetched before the enumerators are built.
+        template <typename TermIterator>
+        void lookup_batch(TermIterator begin, TermIterator end,
+                          std::vector<document_enumerator>& out_enums) const
+        {
+            auto docs_endpoints = m_docs_sequences.endpoints(m_params);
+            auto freqs_endpoints = m_freqs_sequences.endpoints(m_params);
+            uint64_t docs_pos[max_lookup_batch];
+            uint64_t freqs_pos[max_lookup_batch];
+            for_each_lookup_batch
+                (begin, end,
+                 [&](size_t i, uint64_t term) {
+                    assert(term < size());
+                    docs_pos[i] = docs_endpoints.move(term).second;
+                    freqs_pos[i] = freqs_endpoints.move(term).second;
+                    m_docs_sequences.bits().data().prefetch(docs_pos[i] / 64);
+                    m_freqs_sequences.bits().data().prefetch(freqs_pos[i] / 64);
+                },
+                 [&](size_t i, uint64_t) {
+                    out_enums.push_back(make_enumerator
+                        (m_docs_sequences.bits(), docs_pos[i],
+                         m_freqs_sequences.bits(), freqs_pos[i]));
+                });
+        }
+
+        // Looks up the lists of the term ids in [begin, end) and prefetches
+        // their headers, without building the enumerators, so that a
+        // later operator[] or lookup_batch on the same terms finds the
+        // endpoints and the list headers in cache. The headers of
+        // partitioned sequences usually span more than one cache line, so
+        // the first two are prefetched.
+        template <typename TermIterator>
+        void prefetch(TermIterator begin, TermIterator end) const
+        {
+            auto docs_endpoints = m_docs_sequences.endpoints(m_params);
+            auto freqs_endpoints = m_freqs_sequences.endpoints(m_params);
+            auto const& docs_data = m_docs_sequences.bits().data();
+            auto const& freqs_data = m_freqs_sequences.bits().data();
+            for_each_lookup_batch
+                (begin, end,
+                 [&](size_t, uint64_t term) {
+                    assert(term < size());
+                    uint64_t docs_word = docs_endpoints.move(term).second / 64;
+                    uint64_t freqs_word = freqs_endpoints.move(term).second / 64;
+                    docs_data.prefetch(docs_word);
+                    docs_data.prefetch(docs_word + 8);
+                    freqs_data.prefetch(freqs_word);
+                    freqs_data.prefetch(freqs_word + 8);
+                },
+                 [](size_t, uint64_t) {});
+        }
+
+        bitvector_collection const& docs_sequences() const
+        {
+            return m_docs_sequences;
+        }
+
+        bitvector_collection const& freqs_sequences() const
+        {
+            return m_freqs_sequences;
+        }
+
+        // Builds the enumerator of the list whose docs and freqs begin at
+        // the given positions of docs_bits and freqs_bits, which are
+        // docs_sequences().bits() and freqs_sequences().bits(), or copies
+        // of the parts of them that hold the list (see on_demand_index)
+        document_enumerator
+        make_enumerator(succinct::bit_vector const& docs_bits, uint64_t docs_pos,
+                        succinct::bit_vector const& freqs_bits, uint64_t freqs_pos) const
+        {
+            succinct::bit_vector::enumerator docs_it(docs_bits, docs_pos);
             uint64_t occurrences = read_gamma_nonzero(docs_it);
             uint64_t n = 1;
             if (occurrences > 1) {
                 n = docs_it.take(ceil_log2(occurrences + 1));
             }
 
-            typename DocsSequence::enumerator docs_enum(m_docs_sequences.bits(),
+            typename DocsSequence::enumerator docs_enum(docs_bits,
                                                         docs_it.position(),
                                                         num_docs(), n,
                                                         m_params);
 
-            auto freqs_it = m_freqs_sequences.get(m_params, i);
-            typename FreqsSequence::enumerator freqs_enum(m_freqs_sequences.bits(),
-                                                          freqs_it.position(),
+            typename FreqsSequence::enumerator freqs_enum(freqs_bits,
+                                                          freqs_pos,
                                                           occurrences + 1, n,
                                                           m_params);
 
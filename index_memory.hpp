@@ -0,0 +1,388 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#ifndef MAP_HUGE_SHIFT
+#    define MAP_HUGE_SHIFT 26
+#endif
+
+namespace quasi_succinct {
+
+    namespace numa {
+
+        // Linux memory policies, as in <numaif.h>; mbind is called
+        // through syscall() so that libnuma is not needed
+        static const int mpol_bind = 2;
+        static const int mpol_interleave = 3;
+
+        // parses a sysfs list such as "0-3,8,10-11"
+        inline std::vector<size_t> parse_list(std::string const& list)
+        {
+            std::vector<size_t> ret;
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos) end = list.size();
+                std::string range = list.substr(pos, end - pos);
+                size_t dash = range.find('-');
+                if (!range.empty() && range[0] != '\n') {
+                    size_t first = std::stoul(range.substr(0, dash));
+                    size_t last = dash == std::string::npos
+                        ? first : std::stoul(range.substr(dash + 1));
+                    for (size_t i = first; i <= last; ++i) ret.push_back(i);
+                }
+                pos = end + 1;
+            }
+            return ret;
+        }
+
+        inline std::vector<size_t> read_list(std::string const& filename)
+        {
+            std::ifstream is(filename);
+            std::string list;
+            std::getline(is, list);
+            return parse_list(list);
+        }
+
+        // the online nodes; a machine without NUMA support has only node 0
+        inline std::vector<size_t> const& nodes()
+        {
+            static std::vector<size_t> ret = []() {
+                auto nodes = read_list("/sys/devices/system/node/online");
+                if (nodes.empty()) nodes.push_back(0);
+                return nodes;
+            }();
+            return ret;
+        }
+
+        inline size_t num_nodes()
+        {
+            return nodes().size();
+        }
+
+        // index in nodes() of the node the calling thread was pinned to
+        inline size_t& current_node()
+        {
+            static thread_local size_t node = 0;
+            return node;
+        }
+
+        // pins the calling thread to the CPUs of the i-th node
+        inline bool pin_thread(size_t i)
+        {
+            current_node() = i;
+            auto cpus = read_list("/sys/devices/system/node/node"
+                                  + std::to_string(nodes()[i]) + "/cpulist");
+            if (cpus.empty()) return false;
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu: cpus) CPU_SET(cpu, &set);
+            return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+
+        // sets the policy of the pages of [addr, addr + len) to the given
+        // nodes, indices in nodes(); it must be called before the pages
+        // are touched
+        inline bool set_policy(void* addr, size_t len, int mode,
+                               std::vector<size_t> const& node_idxs)
+        {
+            std::vector<unsigned long> mask(1);
+            size_t bits = 8 * sizeof(unsigned long);
+            for (auto i: node_idxs) {
+                size_t node = nodes()[i];
+                if (node / bits >= mask.size()) mask.resize(node / bits + 1);
+                mask[node / bits] |= 1UL << (node % bits);
+            }
+            return !syscall(SYS_mbind, addr, len, mode, mask.data(),
+                            mask.size() * bits + 1, 0);
+        }
+    }
+
+    // Splits [0, size) in at most the given number of chunks, aligned to
+    // 2 MiB, and calls f(begin, end) on each chunk in its own thread
+    template <typename Function>
+    void for_each_chunk(size_t size, size_t threads, Function f)
+    {
+        size_t const align = size_t(1) << 21;
+        threads = std::max<size_t>(threads, 1);
+        size_t chunk = ((size + threads - 1) / threads + align - 1) / align * align;
+        if (threads == 1 || chunk >= size) {
+            f(size_t(0), size);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (size_t begin = 0; begin < size; begin += chunk) {
+            workers.emplace_back(f, begin, std::min(size, begin + chunk));
+        }
+        for (auto& w: workers) {
+            w.join();
+        }
+    }
+
+    // A range of bytes of an index file
+    struct byte_range {
+        uint64_t offset;
+        uint64_t len;
+    };
+
+    // Faults in all the pages of a mapped file from the given number of
+    // threads, each touching a contiguous chunk so that the kernel
+    // readahead still applies; with more than one thread this is faster
+    // than the serial map_flags::warmup
+    inline void parallel_warmup(char const* data, size_t size, size_t threads)
+    {
+        madvise(const_cast<char*>(data), size, MADV_WILLNEED);
+        for_each_chunk(size, threads, [&](size_t begin, size_t end) {
+                volatile char sink = 0;
+                for (size_t i = begin; i < end; i += 4096) {
+                    sink ^= data[i];
+                }
+                (void)sink;
+            });
+    }
+
+    // Faults in only the pages of the given ranges of a mapped file: the
+    // kernel is first asked to read all of them ahead with MADV_WILLNEED,
+    // then their pages are touched from the given number of threads
+    inline void prefault_ranges(char const* data, size_t size,
+                                std::vector<byte_range> ranges, size_t threads)
+    {
+        size_t const page = 4096;
+        uintptr_t base = reinterpret_cast<uintptr_t>(data);
+        std::sort(ranges.begin(), ranges.end(),
+                  [](byte_range const& a, byte_range const& b) {
+                      return a.offset < b.offset;
+                  });
+        for (auto const& r: ranges) {
+            uintptr_t begin = (base + r.offset) / page * page;
+            madvise(reinterpret_cast<void*>(begin),
+                    base + std::min<uint64_t>(r.offset + r.len, size) - begin,
+                    MADV_WILLNEED);
+        }
+
+        // the ranges are split among the threads by their total length
+        std::vector<uint64_t> cumulative(ranges.size() + 1, 0);
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            cumulative[i + 1] = cumulative[i] + ranges[i].len;
+        }
+        for_each_chunk(cumulative.back(), threads, [&](size_t begin, size_t end) {
+                volatile char sink = 0;
+                size_t i = std::upper_bound(cumulative.begin(), cumulative.end(),
+                                            begin) - cumulative.begin() - 1;
+                for (; i < ranges.size() && cumulative[i] < end; ++i) {
+                    uint64_t from = std::max<uint64_t>(begin, cumulative[i]) - cumulative[i];
+                    uint64_t to = std::min<uint64_t>(end, cumulative[i + 1]) - cumulative[i];
+                    for (uint64_t off = from; off < to; off += page) {
+                        sink ^= data[ranges[i].offset + off];
+                    }
+                }
+                (void)sink;
+            });
+    }
+
+    // The bytes of a frozen index, to be passed to succinct::mapper::map.
+    // The page mode is one of
+    //
+    //  - "mmap": the file is memory mapped, as the tools always did;
+    //  - "copy": the file is read into anonymous memory;
+    //  - "huge", "huge_1g": the file is read into 2 MiB or 1 GiB huge
+    //    pages, from the hugetlbfs pool if it has enough free pages, and
+    //    otherwise (only for "huge") into memory advised for transparent
+    //    huge pages.
+    //
+    // A copy can also be bound to a NUMA node or interleaved among all of
+    // them; the placement is set before the pages are first touched. The
+    // copy is read by the given number of threads.
+    class index_memory {
+    public:
+        enum class placement { none, bind, interleave };
+
+        index_memory(const char* filename,
+                     std::string const& page_mode = "mmap",
+                     placement place = placement::none,
+                     size_t node = 0,
+                     size_t threads = 1)
+            : m_page_mode(page_mode)
+            , m_data(nullptr)
+            , m_size(0)
+            , m_mapping(nullptr)
+            , m_mapping_size(0)
+        {
+            if (page_mode == "mmap") {
+                if (place != placement::none) {
+                    throw std::invalid_argument("NUMA placement needs a copy of the index");
+                }
+                m_file.open(filename);
+                m_data = m_file.data();
+                m_size = m_file.size();
+                m_backing = "page cache";
+                return;
+            }
+
+            int fd = ::open(filename, O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error(std::string("Cannot open ") + filename
+                                         + ": " + std::strerror(errno));
+            }
+            struct stat st;
+            fstat(fd, &st);
+            m_size = st.st_size;
+
+            try {
+                allocate(page_mode);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+
+            if (place == placement::bind) {
+                numa::set_policy(m_mapping, m_mapping_size, numa::mpol_bind,
+                                 std::vector<size_t>(1, node));
+            } else if (place == placement::interleave) {
+                std::vector<size_t> all(numa::num_nodes());
+                for (size_t i = 0; i < all.size(); ++i) all[i] = i;
+                numa::set_policy(m_mapping, m_mapping_size, numa::mpol_interleave, all);
+            }
+
+            // each thread reads a contiguous chunk, so that the pages are
+            // also first touched in parallel
+            char* buf = static_cast<char*>(m_mapping);
+            std::atomic<bool> failed(false);
+            for_each_chunk(m_size, threads, [&](size_t begin, size_t end) {
+                    while (begin < end && !failed) {
+                        ssize_t ret = pread(fd, buf + begin,
+                                            std::min<size_t>(end - begin, 1 << 30),
+                                            begin);
+                        if (ret <= 0) {
+                            failed = true;
+                        } else {
+                            begin += ret;
+                        }
+                    }
+                });
+            ::close(fd);
+            if (failed) {
+                munmap(m_mapping, m_mapping_size);
+                m_mapping = nullptr;
+                throw std::runtime_error(std::string("Error reading ") + filename);
+            }
+            m_data = buf;
+        }
+
+        ~index_memory()
+        {
+            if (m_mapping) {
+                munmap(m_mapping, m_mapping_size);
+            }
+        }
+
+        char const* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        std::string const& page_mode() const
+        {
+            return m_page_mode;
+        }
+
+        // where the pages come from: "page cache", "anonymous",
+        // "hugetlb 2M", "hugetlb 1G" or "transparent huge pages"
+        std::string const& backing() const
+        {
+            return m_backing;
+        }
+
+    private:
+        index_memory(index_memory const&);
+        index_memory& operator=(index_memory const&);
+
+        void allocate(std::string const& page_mode)
+        {
+            size_t page_size = 4096;
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+            if (page_mode == "huge" || page_mode == "huge_1g") {
+                bool gb = page_mode == "huge_1g";
+                page_size = gb ? (size_t(1) << 30) : (size_t(1) << 21);
+                m_mapping_size = round_up(m_size, page_size);
+                m_mapping = mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE,
+                                 flags | MAP_HUGETLB | ((gb ? 30 : 21) << MAP_HUGE_SHIFT),
+                                 -1, 0);
+                if (m_mapping != MAP_FAILED) {
+                    m_backing = gb ? "hugetlb 1G" : "hugetlb 2M";
+                    return;
+                }
+                m_mapping = nullptr;
+                if (gb) {
+                    throw std::runtime_error("Not enough free 1 GiB huge pages");
+                }
+
+                // over-allocate to align the copy to a huge page, so that
+                // all of it can be backed by transparent huge pages
+                size_t aligned_size = m_mapping_size + page_size;
+                char* p = static_cast<char*>(mmap(nullptr, aligned_size,
+                                                  PROT_READ | PROT_WRITE,
+                                                  flags, -1, 0));
+                if (p == MAP_FAILED) throw std::bad_alloc();
+                char* aligned = reinterpret_cast<char*>
+                    (round_up(reinterpret_cast<uintptr_t>(p), page_size));
+                if (aligned != p) munmap(p, aligned - p);
+                size_t tail = (p + aligned_size) - (aligned + m_mapping_size);
+                if (tail) munmap(aligned + m_mapping_size, tail);
+                m_mapping = aligned;
+                madvise(m_mapping, m_mapping_size, MADV_HUGEPAGE);
+                m_backing = "transparent huge pages";
+            } else if (page_mode == "copy") {
+                m_mapping_size = round_up(std::max<size_t>(m_size, 1), page_size);
+                m_mapping = mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE,
+                                 flags, -1, 0);
+                if (m_mapping == MAP_FAILED) {
+                    m_mapping = nullptr;
+                    throw std::bad_alloc();
+                }
+                m_backing = "anonymous";
+            } else {
+                throw std::invalid_argument("Unknown page mode " + page_mode);
+            }
+        }
+
+        static size_t round_up(size_t x, size_t page_size)
+        {
+            return (x + page_size - 1) / page_size * page_size;
+        }
+
+        std::string m_page_mode;
+        std::string m_backing;
+        char const* m_data;
+        size_t m_size;
+        boost::iostreams::mapped_file_source m_file;
+        void* m_mapping;
+        size_t m_mapping_size;
+    };
+
+}
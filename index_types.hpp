@@ -30,6 +30,11 @@ namespace quasi_succinct {
         positive_sequence<partitioned_sequence<strict_sequence>>
         > opt_index;
 
+    typedef freq_index<
+        partitioned_sequence<bitpacked_indexed_sequence>,
+        positive_sequence<partitioned_sequence<strict_sequence>>
+        > opt_bitpacked_index;
+
     typedef block_freq_index<quasi_succinct::optpfor_block> block_optpfor_index;
 
     typedef block_freq_index<quasi_succinct::varint_G8IU_block> block_varint_index;
@@ -41,6 +46,10 @@ namespace quasi_succinct {
     typedef block_freq_index<quasi_succinct::vbyte_block> block_vbyte_index;
 
     typedef block_freq_index<quasi_succinct::simple16_block> block_simple16_index;
+
+    typedef block_freq_index<quasi_succinct::simdbp128_block> block_simdbp128_index;
+
+    typedef block_freq_index<quasi_succinct::simd_pfor_block> block_simd_pfor_index;
 }
 
-#define QS_INDEX_TYPES (ef)(single)(uniform)(opt)(block_optpfor)(block_varint)(block_interpolative)(block_u32)(block_vbyte)(block_simple16)
+#define QS_INDEX_TYPES (ef)(single)(uniform)(opt)(opt_bitpacked)(block_optpfor)(block_varint)(block_interpolative)(block_u32)(block_vbyte)(block_simple16)(block_simdbp128)(block_simd_pfor)
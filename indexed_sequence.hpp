@@ -1,71 +1,110 @@
 #pragma once
 
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #include "compact_elias_fano.hpp"
 #include "compact_ranked_bitvector.hpp"
 #include "all_ones_sequence.hpp"
+#include "bitpacked_sequence.hpp"
+#include "configuration.hpp"
+#include "decode_cost.hpp"
 #include "global_parameters.hpp"
 
 namespace quasi_succinct {
 
-    struct indexed_sequence {
+    // With Bitpacked, a sequence can also be stored as a
+    // bitpacked_sequence, which costs a second type bit. Its size depends
+    // on the largest gap, so it is only considered by write and by the
+    // overloads that take the largest gap.
+    template <bool Bitpacked>
+    struct basic_indexed_sequence {
 
         enum index_type {
             elias_fano = 0,
             ranked_bitvector = 1,
             all_ones = 2,
+            bitpacked = 3,
 
-            index_types = 3
+            index_types = 4
         };
 
-        static const uint64_t type_bits = 1; // all_ones is implicit
+        static const uint64_t type_bits = Bitpacked ? 2 : 1; // all_ones is implicit
 
-        static QS_FLATTEN_FUNC uint64_t
-        bitsize(global_parameters const& params, uint64_t universe, uint64_t n)
+        typedef std::pair<index_type, uint64_t> type_cost;
+
+        // The type of a sequence and its cost: its size in bits plus the
+        // decode_cost of the type with the given lambda. all_ones is
+        // implicit, so it is the only choice when universe == n.
+        static QS_FLATTEN_FUNC type_cost
+        best_type(global_parameters const& params, uint64_t universe, uint64_t n,
+                  double lambda)
         {
-            uint64_t best_cost = all_ones_sequence::bitsize(params, universe, n);
+            if (all_ones_sequence::bitsize(params, universe, n) == 0) {
+                return type_cost(all_ones,
+                                 decode_cost::cost(decode_cost::all_ones, universe, n, lambda));
+            }
+
+            type_cost best(elias_fano,
+                           compact_elias_fano::bitsize(params, universe, n) + type_bits
+                           + decode_cost::cost(decode_cost::elias_fano, universe, n, lambda));
 
-            uint64_t ef_cost = compact_elias_fano::bitsize(params, universe, n) + type_bits;
-            if (ef_cost < best_cost) {
-                best_cost = ef_cost;
+            uint64_t rb_cost = compact_ranked_bitvector::bitsize(params, universe, n) + type_bits
+                + decode_cost::cost(decode_cost::ranked_bitvector, universe, n, lambda);
+            if (rb_cost < best.second) {
+                best = type_cost(ranked_bitvector, rb_cost);
             }
 
-            uint64_t rb_cost = compact_ranked_bitvector::bitsize(params, universe, n) + type_bits;
-            if (rb_cost < best_cost) {
-                best_cost = rb_cost;
+            return best;
+        }
+
+        template <bool Enable = Bitpacked>
+        static QS_FLATTEN_FUNC typename std::enable_if<Enable, type_cost>::type
+        best_type(global_parameters const& params, uint64_t universe, uint64_t n,
+                  uint64_t max_gap, double lambda)
+        {
+            type_cost best = best_type(params, universe, n, lambda);
+            uint64_t bp_size = bitpacked_sequence::bitsize(params, universe, n, max_gap);
+            if (best.first != all_ones && bp_size != uint64_t(-1)) {
+                uint64_t bp_cost = bp_size + type_bits
+                    + decode_cost::cost(decode_cost::bitpacked, universe, n, lambda);
+                if (bp_cost < best.second) {
+                    best = type_cost(bitpacked, bp_cost);
+                }
             }
+            return best;
+        }
 
-            return best_cost;
+        static QS_FLATTEN_FUNC uint64_t
+        bitsize(global_parameters const& params, uint64_t universe, uint64_t n)
+        {
+            return best_type(params, universe, n, 0).second;
         }
 
+        template <bool Enable = Bitpacked>
+        static QS_FLATTEN_FUNC typename std::enable_if<Enable, uint64_t>::type
+        bitsize(global_parameters const& params, uint64_t universe, uint64_t n,
+                uint64_t max_gap)
+        {
+            return best_type(params, universe, n, max_gap, 0).second;
+        }
+
+        // the type is chosen with the lambda of the configuration, as in
+        // the cost function of partitioned_sequence
         template <typename Iterator>
         static void write(succinct::bit_vector_builder& bvb,
                           Iterator begin,
                           uint64_t universe, uint64_t n,
                           global_parameters const& params)
         {
-            uint64_t best_cost = all_ones_sequence::bitsize(params, universe, n);
-            int best_type = all_ones;
-
-            if (best_cost) {
-                uint64_t ef_cost = compact_elias_fano::bitsize(params, universe, n) + type_bits;
-                if (ef_cost < best_cost) {
-                    best_cost = ef_cost;
-                    best_type = elias_fano;
-                }
-
-                uint64_t rb_cost = compact_ranked_bitvector::bitsize(params, universe, n) + type_bits;
-                if (rb_cost < best_cost) {
-                    best_cost = rb_cost;
-                    best_type = ranked_bitvector;
-                }
-
-                bvb.append_bits(best_type, type_bits);
+            index_type type = write_type(begin, universe, n, params,
+                                         std::integral_constant<bool, Bitpacked>());
+            if (type != all_ones) {
+                bvb.append_bits(type, type_bits);
             }
 
-
-            switch (best_type) {
+            switch (type) {
             case elias_fano:
                 compact_elias_fano::write(bvb, begin,
                                           universe, n,
@@ -81,11 +120,34 @@ namespace quasi_succinct {
                                          universe, n,
                                          params);
                 break;
+            case bitpacked:
+                bitpacked_sequence::write(bvb, begin,
+                                          universe, n,
+                                          params);
+                break;
             default:
                 assert(false);
             }
         }
 
+    private:
+        template <typename Iterator>
+        static index_type write_type(Iterator, uint64_t universe, uint64_t n,
+                                     global_parameters const& params, std::false_type)
+        {
+            return best_type(params, universe, n,
+                             configuration::get().speed_lambda).first;
+        }
+
+        template <typename Iterator>
+        static index_type write_type(Iterator begin, uint64_t universe, uint64_t n,
+                                     global_parameters const& params, std::true_type)
+        {
+            return best_type(params, universe, n, bitpacked_sequence::max_gap(begin, n),
+                             configuration::get().speed_lambda).first;
+        }
+
+    public:
         class enumerator {
         public:
 
@@ -121,6 +183,11 @@ namespace quasi_succinct {
                                                                     universe, n,
                                                                     params);
                     break;
+                case bitpacked:
+                    m_bp_enumerator = bitpacked_enumerator(bv, offset + type_bits,
+                                                           universe, n,
+                                                           params);
+                    break;
                 default:
                     throw std::invalid_argument("Unsupported type");
                 }
@@ -136,6 +203,8 @@ namespace quasi_succinct {
                     return m_rb_enumerator.METHOD ACTUALS;          \
                 case all_ones:                                      \
                     return m_ao_enumerator.METHOD ACTUALS;          \
+                case bitpacked:                                     \
+                    return m_bp_enumerator.METHOD ACTUALS;          \
                 default:                                            \
                     assert(false);                                  \
                     __builtin_unreachable();                        \
@@ -150,17 +219,31 @@ namespace quasi_succinct {
             ENUMERATOR_METHOD(value_type, next, (), ());
             ENUMERATOR_METHOD(uint64_t, size, () const, ());
             ENUMERATOR_METHOD(uint64_t, prev_value, () const, ());
+            ENUMERATOR_METHOD(void, decode_range,
+                              (uint64_t position, uint64_t count, uint32_t* out),
+                              (position, count, out));
 
 #undef ENUMERATOR_METHOD
 #undef ENUMERATOR_VOID_METHOD
 
         private:
+            // without Bitpacked the type is never bitpacked, and the union
+            // does not grow
+            typedef typename std::conditional<Bitpacked,
+                                              bitpacked_sequence::enumerator,
+                                              all_ones_sequence::enumerator>::type
+                bitpacked_enumerator;
+
             index_type m_type;
             union {
                 compact_elias_fano::enumerator m_ef_enumerator;
                 compact_ranked_bitvector::enumerator m_rb_enumerator;
                 all_ones_sequence::enumerator m_ao_enumerator;
+                bitpacked_enumerator m_bp_enumerator;
             };
         };
     };
+
+    typedef basic_indexed_sequence<false> indexed_sequence;
+    typedef basic_indexed_sequence<true> bitpacked_indexed_sequence;
 }
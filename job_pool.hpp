@@ -0,0 +1,271 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+
+#include "configuration.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // Runs the prepare() of the jobs on a fixed set of worker threads, and
+    // their commit() in the order in which the jobs were added. Each worker
+    // has its own queue and steals from the others when it runs dry.
+    // Prepared jobs wait in a reorder buffer, and the worker that completes
+    // the oldest pending job commits the run of ready jobs that follows
+    // it, so a slow job delays only the commits after it. add_job blocks
+    // while the work added and not yet committed exceeds work_per_thread
+    // times the number of threads.
+    class job_pool {
+    public:
+
+        job_pool(double work_per_thread)
+            : m_max_threads(configuration::get().worker_threads)
+            , m_max_pending_work(work_per_thread * m_max_threads)
+            , m_next_index(0)
+            , m_committed(0)
+            , m_pending_work(0)
+            , m_reorder_begin(0)
+            , m_queued(0)
+            , m_stop(false)
+            , m_steals(0)
+            , m_stall_time(0)
+            , m_max_reorder_size(0)
+            , m_busy_time(m_max_threads, 0)
+            , m_start_time(get_time_usecs())
+            , m_elapsed_time(0)
+        {
+            logger() << "job_pool using " << m_max_threads
+                     << " worker threads" << std::endl;
+
+            for (size_t i = 0; i < m_max_threads; ++i) {
+                m_queues.emplace_back(new worker_queue());
+            }
+            for (size_t i = 0; i < m_max_threads; ++i) {
+                m_threads.emplace_back([this, i]() { worker(i); });
+            }
+        }
+
+        ~job_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_work_cv.notify_all();
+            for (auto& t: m_threads) {
+                t.join();
+            }
+        }
+
+        class job {
+        public:
+            virtual void prepare() = 0;
+            virtual void commit() = 0;
+        };
+
+        typedef std::shared_ptr<job> job_ptr_type;
+
+        void add_job(job_ptr_type j, double expected_work)
+        {
+            if (!m_max_threads) { // all in main thread
+                j->prepare();
+                j->commit();
+                j.reset();
+                return;
+            }
+
+            uint64_t index;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_pending_work >= m_max_pending_work) {
+                    double tick = get_time_usecs();
+                    m_done_cv.wait(lock, [&]() {
+                            return m_pending_work < m_max_pending_work;
+                        });
+                    m_stall_time += get_time_usecs() - tick;
+                }
+                index = m_next_index++;
+                m_reorder.push_back(reorder_entry { j, expected_work, false });
+                m_pending_work += expected_work;
+                m_max_reorder_size = std::max(m_max_reorder_size, m_reorder.size());
+            }
+
+            {
+                auto& q = *m_queues[index % m_max_threads];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                q.jobs.push_back(queue_entry { index, j });
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_queued;
+            }
+            m_work_cv.notify_one();
+        }
+
+        void complete()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done_cv.wait(lock, [&]() { return m_committed == m_next_index; });
+            m_elapsed_time = get_time_usecs() - m_start_time;
+        }
+
+        size_t threads() const
+        {
+            return m_max_threads;
+        }
+
+        // fraction of the time between the construction of the pool and
+        // the last complete() spent by the workers preparing jobs
+        double utilization() const
+        {
+            if (!m_max_threads || !m_elapsed_time) return 0;
+            double busy = 0;
+            for (auto t: m_busy_time) busy += t;
+            return busy / (m_elapsed_time * m_max_threads);
+        }
+
+        uint64_t steals() const
+        {
+            return m_steals;
+        }
+
+        // time spent by add_job waiting for the pending work to drain
+        double stall_time_usecs() const
+        {
+            return m_stall_time;
+        }
+
+        size_t max_reorder_size() const
+        {
+            return m_max_reorder_size;
+        }
+
+    private:
+
+        struct queue_entry {
+            uint64_t index;
+            job_ptr_type j;
+        };
+
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<queue_entry> jobs;
+        };
+
+        struct reorder_entry {
+            job_ptr_type j;
+            double work;
+            bool ready;
+        };
+
+        bool pop(size_t id, queue_entry& e)
+        {
+            // the own queue first, then steal from the others; both take the
+            // oldest job, so that the commits can proceed
+            for (size_t k = 0; k < m_max_threads; ++k) {
+                auto& q = *m_queues[(id + k) % m_max_threads];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.jobs.empty()) {
+                    e = std::move(q.jobs.front());
+                    q.jobs.pop_front();
+                    --m_queued;
+                    if (k) ++m_steals;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void worker(size_t id)
+        {
+            while (true) {
+                queue_entry e;
+                if (!pop(id, e)) {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_work_cv.wait(lock, [&]() { return m_stop || m_queued > 0; });
+                    if (m_stop && m_queued <= 0) return;
+                    continue;
+                }
+
+                double tick = get_time_usecs();
+                e.j->prepare();
+                m_busy_time[id] += get_time_usecs() - tick;
+                e.j.reset();
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_reorder[e.index - m_reorder_begin].ready = true;
+                }
+                commit_ready_jobs();
+            }
+        }
+
+        void commit_ready_jobs()
+        {
+            while (true) {
+                // if another worker is committing it will also pick up the
+                // job just marked as ready, see the check below
+                std::unique_lock<std::mutex> commit_lock(m_commit_mutex,
+                                                         std::try_to_lock);
+                if (!commit_lock.owns_lock()) return;
+
+                while (true) {
+                    reorder_entry entry;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        if (m_reorder.empty() || !m_reorder.front().ready) break;
+                        entry = std::move(m_reorder.front());
+                        m_reorder.pop_front();
+                        m_reorder_begin += 1;
+                    }
+                    entry.j->commit();
+                    entry.j.reset();
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_committed += 1;
+                        m_pending_work -= entry.work;
+                    }
+                    m_done_cv.notify_all();
+                }
+                commit_lock.unlock();
+
+                // a job may have become ready after the last check, while
+                // its worker could not take the commit lock
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_reorder.empty() || !m_reorder.front().ready) return;
+            }
+        }
+
+        size_t m_max_threads;
+        double m_max_pending_work;
+
+        std::mutex m_mutex; // protects everything below except the queues
+        std::mutex m_commit_mutex;
+        std::condition_variable m_work_cv;
+        std::condition_variable m_done_cv;
+        uint64_t m_next_index;
+        uint64_t m_committed;
+        double m_pending_work;
+        std::deque<reorder_entry> m_reorder;
+        uint64_t m_reorder_begin; // index of the job at the front of m_reorder
+        std::atomic<int64_t> m_queued;
+        bool m_stop;
+
+        std::atomic<uint64_t> m_steals;
+        double m_stall_time;
+        size_t m_max_reorder_size;
+        std::vector<double> m_busy_time; // each slot written by its worker
+        double m_start_time;
+        double m_elapsed_time;
+
+        std::vector<std::unique_ptr<worker_queue>> m_queues;
+        std::vector<std::thread> m_threads;
+    };
+
+}
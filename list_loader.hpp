@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <succinct/mapper.hpp>
+
+#include "block_freq_index.hpp"
+#include "file_reader.hpp"
+#include "freq_index.hpp"
+#include "index_memory.hpp"
+
+namespace quasi_succinct {
+
+    // Where the lists of an index type are in its file, and how to read
+    // them into memory of their own. For each term, ranges() gives the
+    // parts of the file (relative to the base address it is mapped at)
+    // that hold its list; plan() sets up the reads of those parts into a
+    // list_copy, finish() prepares the copy once they are done, and open()
+    // builds the enumerator on it.
+    template <typename Index>
+    struct list_loader;
+
+    // The lists are in the bitvectors of the two bitvector_collections.
+    // A part is copied into a frozen image of a bit_vector, that is
+    // preceded by the mapper flags, the size in bits and the number of
+    // words, so that a bit_vector can be mapped on it; two more words
+    // after the list are copied, or zero-filled past the end of the file,
+    // since the sequences may read across word boundaries.
+    template <typename DocsSequence, typename FreqsSequence>
+    struct list_loader<freq_index<DocsSequence, FreqsSequence>> {
+        typedef freq_index<DocsSequence, FreqsSequence> index_type;
+        typedef typename index_type::document_enumerator document_enumerator;
+
+        static const size_t parts = 2;
+        static const size_t header_words = 3;
+        static const size_t padding_words = 2;
+
+        struct list_copy {
+            std::vector<uint64_t> images[parts];
+            succinct::bit_vector bits[parts];
+            uint64_t positions[parts];
+
+            size_t bytes() const
+            {
+                return (images[0].size() + images[1].size()) * sizeof(uint64_t);
+            }
+        };
+
+        // the bits [begin, end) of each collection that hold the list
+        static void extents(index_type const& index, size_t term,
+                            std::pair<uint64_t, uint64_t>* out)
+        {
+            bitvector_collection const* colls[parts] = {
+                &index.docs_sequences(), &index.freqs_sequences()
+            };
+            for (size_t p = 0; p < parts; ++p) {
+                auto const& coll = *colls[p];
+                auto endpoints = coll.endpoints(index.params());
+                out[p].first = endpoints.move(term).second;
+                out[p].second = term + 1 < coll.size()
+                    ? endpoints.move(term + 1).second : coll.bits().size();
+            }
+        }
+
+        static uint64_t const* words(index_type const& index, size_t p)
+        {
+            return (p ? index.freqs_sequences() : index.docs_sequences())
+                .bits().data().data();
+        }
+
+        static void ranges(index_type const& index, size_t term,
+                           char const* file_base, byte_range* out)
+        {
+            std::pair<uint64_t, uint64_t> ext[parts];
+            extents(index, term, ext);
+            for (size_t p = 0; p < parts; ++p) {
+                out[p].offset = reinterpret_cast<char const*>
+                    (words(index, p) + ext[p].first / 64) - file_base;
+                out[p].len = ((ext[p].second + 63) / 64 - ext[p].first / 64)
+                    * sizeof(uint64_t);
+            }
+        }
+
+        static void plan(index_type const& index, size_t term,
+                         char const* file_base, list_copy& copy,
+                         file_reader::request* reqs)
+        {
+            std::pair<uint64_t, uint64_t> ext[parts];
+            extents(index, term, ext);
+            for (size_t p = 0; p < parts; ++p) {
+                uint64_t begin = ext[p].first;
+                uint64_t end = ext[p].second;
+                uint64_t total_words = (p ? index.freqs_sequences()
+                                        : index.docs_sequences()).bits().data().size();
+                uint64_t first_word = begin / 64;
+                uint64_t last_word = std::min(total_words,
+                                              (end + 63) / 64 + padding_words);
+                uint64_t n = last_word - first_word;
+
+                auto& image = copy.images[p];
+                image.assign(header_words + n + padding_words, 0);
+                image[1] = (n + padding_words) * 64;
+                image[2] = n + padding_words;
+                copy.positions[p] = begin - first_word * 64;
+
+                reqs[p].buf = image.data() + header_words;
+                reqs[p].len = n * sizeof(uint64_t);
+                reqs[p].offset = reinterpret_cast<char const*>
+                    (words(index, p) + first_word) - file_base;
+            }
+        }
+
+        static void finish(list_copy& copy)
+        {
+            for (size_t p = 0; p < parts; ++p) {
+                succinct::mapper::map(copy.bits[p],
+                                      reinterpret_cast<char const*>(copy.images[p].data()));
+            }
+        }
+
+        static document_enumerator open(index_type const& index,
+                                        list_copy const& copy)
+        {
+            return index.make_enumerator(copy.bits[0], copy.positions[0],
+                                         copy.bits[1], copy.positions[1]);
+        }
+    };
+
+    // The lists are byte ranges of m_lists; the block codecs may read up
+    // to a few words past the end of a block, so the copy is padded
+    template <typename BlockCodec>
+    struct list_loader<block_freq_index<BlockCodec>> {
+        typedef block_freq_index<BlockCodec> index_type;
+        typedef typename index_type::document_enumerator document_enumerator;
+
+        static const size_t parts = 1;
+        static const size_t padding_bytes = 64;
+
+        struct list_copy {
+            std::vector<uint8_t> data;
+
+            size_t bytes() const
+            {
+                return data.size();
+            }
+        };
+
+        static void ranges(index_type const& index, size_t term,
+                           char const* file_base, byte_range* out)
+        {
+            auto endpoints = index.list_endpoints();
+            uint64_t begin = endpoints.move(term).second;
+            uint64_t end = term + 1 < index.size()
+                ? endpoints.move(term + 1).second : index.lists().size();
+            out[0].offset = reinterpret_cast<char const*>(index.lists().data() + begin)
+                - file_base;
+            out[0].len = end - begin;
+        }
+
+        static void plan(index_type const& index, size_t term,
+                         char const* file_base, list_copy& copy,
+                         file_reader::request* reqs)
+        {
+            byte_range range;
+            ranges(index, term, file_base, &range);
+            copy.data.assign(range.len + padding_bytes, 0);
+            reqs[0].buf = copy.data.data();
+            reqs[0].len = range.len;
+            reqs[0].offset = range.offset;
+        }
+
+        static void finish(list_copy&)
+        {}
+
+        static document_enumerator open(index_type const& index,
+                                        list_copy const& copy)
+        {
+            return document_enumerator(copy.data.data(), index.num_docs());
+        }
+    };
+
+}
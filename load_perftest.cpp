@@ -0,0 +1,133 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "loaded_index.hpp"
+#include "util.hpp"
+
+// Compares the load modes of loaded_index on a random-access workload:
+// each operation opens the list of a random term and skips to a random
+// docid, so nearly every access is a TLB miss on a large index
+
+template <typename IndexType>
+double random_access_nsecs(quasi_succinct::loaded_index<IndexType> const& index,
+                           std::string const& numa_mode,
+                           size_t threads, size_t ops)
+{
+    using namespace quasi_succinct;
+
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> checksum(0);
+    auto tick = get_time_usecs();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+                if (numa_mode != "none") {
+                    numa::pin_thread(t % numa::num_nodes());
+                }
+                uint64_t state = t + 1;
+                uint64_t sum = 0;
+                for (size_t i = 0; i < ops; ++i) {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    uint64_t term = (state >> 33) % index.size();
+                    auto e = index[term];
+                    e.next_geq((state >> 11) % index.num_docs());
+                    sum += e.docid();
+                }
+                checksum += sum;
+            });
+    }
+    for (auto& w: workers) {
+        w.join();
+    }
+    do_not_optimize_away(checksum.load());
+    return (get_time_usecs() - tick) * 1000 / (ops * threads);
+}
+
+template <typename IndexType>
+void load_perftest(const char* index_filename,
+                   std::vector<std::string> const& modes,
+                   std::string const& type)
+{
+    using namespace quasi_succinct;
+
+    size_t threads = std::max<size_t>(1, configuration::get().query_threads);
+    size_t ops = 1 << 20;
+
+    for (auto const& mode: modes) {
+        // "<load mode>" or "<load mode>:<NUMA mode>"
+        size_t colon = mode.find(':');
+        std::string load_mode = mode.substr(0, colon);
+        std::string numa_mode = colon == std::string::npos
+            ? "none" : mode.substr(colon + 1);
+
+        logger() << "Loading " << index_filename << " (load mode "
+                 << load_mode << ", NUMA mode " << numa_mode << ")" << std::endl;
+        double tick = get_time_usecs();
+        std::unique_ptr<loaded_index<IndexType>> index;
+        try {
+            index.reset(new loaded_index<IndexType>(index_filename,
+                                                    load_mode, numa_mode));
+        } catch (std::exception const& e) {
+            logger() << "Skipping: " << e.what() << std::endl;
+            continue;
+        }
+        double load_secs = (get_time_usecs() - tick) / 1000000;
+
+        // the first round faults in the pages that are still missing
+        random_access_nsecs(*index, numa_mode, threads, ops);
+        double nsecs = random_access_nsecs(*index, numa_mode, threads, ops);
+        logger() << "Backed by " << index->memory().backing()
+                 << ", loaded in " << load_secs << " seconds, "
+                 << nsecs << " ns per random access" << std::endl;
+
+        stats_line()
+            ("type", type)
+            ("load_mode", load_mode)
+            ("numa_mode", numa_mode)
+            ("backing", index->memory().backing())
+            ("threads", threads)
+            ("load_time", load_secs)
+            ("access_ns", nsecs)
+            ;
+    }
+}
+
+int main(int argc, const char** argv)
+{
+    using namespace quasi_succinct;
+
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <index filename>"
+                  << " [<load mode>[:<NUMA mode>]...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    const char* index_filename = argv[2];
+    std::vector<std::string> modes(argv + 3, argv + argc);
+    if (modes.empty()) {
+        modes = {"mmap", "copy", "huge", "huge_1g"};
+        if (numa::num_nodes() > 1) {
+            modes.push_back("huge:interleave");
+            modes.push_back("huge:replicate");
+        }
+    }
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                   \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {             \
+            load_perftest<BOOST_PP_CAT(T, _index)>              \
+                (index_filename, modes, type);                  \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << type << std::endl;
+    }
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <succinct/mapper.hpp>
+
+#include "index_memory.hpp"
+#include "list_loader.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // An index loaded in memory with the given page mode (see
+    // index_memory) and NUMA mode, which is one of
+    //
+    //  - "none": a single copy, placed by the kernel;
+    //  - "interleave": a single copy with the pages interleaved among the
+    //    nodes;
+    //  - "replicate": a copy bound to each node. Lookups go to the copy of
+    //    the node the calling thread is pinned to (see numa::pin_thread),
+    //    so the threads always read the posting lists from local memory.
+    //
+    // It has the interface used by the query operators, so it can be
+    // passed in place of the index.
+    template <typename Index>
+    class loaded_index {
+    public:
+        typedef typename Index::document_enumerator document_enumerator;
+
+        // The index is read or, if memory mapped, paged in by the given
+        // number of threads. If hot_terms is given, only the lists of
+        // those terms are paged in (see read_hot_terms).
+        loaded_index(const char* filename,
+                     std::string const& page_mode = "mmap",
+                     std::string const& numa_mode = "none",
+                     size_t threads = 1,
+                     std::vector<uint64_t> const* hot_terms = nullptr)
+        {
+            typedef index_memory::placement placement;
+            size_t copies = 1;
+            placement place = placement::none;
+            if (numa_mode == "replicate") {
+                copies = numa::num_nodes();
+                place = placement::bind;
+            } else if (numa_mode == "interleave") {
+                place = placement::interleave;
+            } else if (numa_mode != "none") {
+                throw std::invalid_argument("Unknown NUMA mode " + numa_mode);
+            }
+
+            for (size_t node = 0; node < copies; ++node) {
+                m_memory.emplace_back(new index_memory(filename, page_mode,
+                                                       place, node, threads));
+                m_replicas.emplace_back(new Index());
+                succinct::mapper::map(*m_replicas.back(),
+                                      m_memory.back()->data());
+            }
+
+            // a copy is already in memory, a mapped file is paged in
+            if (page_mode == "mmap") {
+                index_memory const& mem = *m_memory[0];
+                if (hot_terms) {
+                    std::vector<byte_range> ranges;
+                    byte_range parts[list_loader<Index>::parts];
+                    for (auto term: *hot_terms) {
+                        if (term >= size()) continue;
+                        list_loader<Index>::ranges(*m_replicas[0], term,
+                                                   mem.data(), parts);
+                        ranges.insert(ranges.end(), parts,
+                                      parts + list_loader<Index>::parts);
+                    }
+                    prefault_ranges(mem.data(), mem.size(), ranges, threads);
+                } else {
+                    parallel_warmup(mem.data(), mem.size(), threads);
+                }
+            }
+        }
+
+        // From now on, remember the terms whose lists are accessed
+        void record_accesses()
+        {
+            m_accessed.reset(new std::atomic<bool>[size()]);
+            for (size_t i = 0; i < size(); ++i) {
+                m_accessed[i] = false;
+            }
+        }
+
+        // the terms accessed since record_accesses was called
+        std::vector<uint64_t> accessed_terms() const
+        {
+            std::vector<uint64_t> terms;
+            if (m_accessed) {
+                for (size_t i = 0; i < size(); ++i) {
+                    if (m_accessed[i].load(std::memory_order_relaxed)) {
+                        terms.push_back(i);
+                    }
+                }
+            }
+            return terms;
+        }
+
+        uint64_t size() const
+        {
+            return m_replicas[0]->size();
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_replicas[0]->num_docs();
+        }
+
+        size_t replicas() const
+        {
+            return m_replicas.size();
+        }
+
+        index_memory const& memory() const
+        {
+            return *m_memory[0];
+        }
+
+        Index const& local() const
+        {
+            return *m_replicas[numa::current_node() % m_replicas.size()];
+        }
+
+        document_enumerator operator[](size_t term) const
+        {
+            record(term);
+            return local()[term];
+        }
+
+        template <typename TermIterator>
+        void lookup_batch(TermIterator begin, TermIterator end,
+                          std::vector<document_enumerator>& out_enums) const
+        {
+            for (TermIterator it = begin; m_accessed && it != end; ++it) {
+                record(batch_term_id(*it));
+            }
+            local().lookup_batch(begin, end, out_enums);
+        }
+
+        template <typename TermIterator>
+        void prefetch(TermIterator begin, TermIterator end) const
+        {
+            local().prefetch(begin, end);
+        }
+
+    private:
+        void record(uint64_t term) const
+        {
+            // read first, so that the hot terms do not bounce the cache
+            // line among the threads
+            if (m_accessed && !m_accessed[term].load(std::memory_order_relaxed)) {
+                m_accessed[term].store(true, std::memory_order_relaxed);
+            }
+        }
+
+        std::vector<std::unique_ptr<index_memory>> m_memory;
+        std::vector<std::unique_ptr<Index>> m_replicas;
+        std::unique_ptr<std::atomic<bool>[]> m_accessed;
+    };
+
+    // The hot terms sidecar file has a term id per line; it is written
+    // after a run with the terms accessed during it (see
+    // loaded_index::accessed_terms), so that on the next start only their
+    // lists are paged in
+    inline std::vector<uint64_t> read_hot_terms(const char* filename)
+    {
+        std::ifstream is(filename);
+        if (!is) {
+            throw std::runtime_error(std::string("Cannot open ") + filename);
+        }
+        std::vector<uint64_t> terms;
+        uint64_t term;
+        while (is >> term) {
+            terms.push_back(term);
+        }
+        return terms;
+    }
+
+    inline void write_hot_terms(const char* filename,
+                                std::vector<uint64_t> const& terms)
+    {
+        std::ofstream os(filename);
+        for (auto term: terms) {
+            os << term << '\n';
+        }
+    }
+
+}
@@ -0,0 +1,287 @@
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <succinct/mapper.hpp>
+
+#include "configuration.hpp"
+#include "index_types.hpp"
+#include "job_pool.hpp"
+#include "util.hpp"
+
+using quasi_succinct::logger;
+
+// The shards are indexes of the same type over consecutive docid ranges,
+// in the order in which they are given, and they share the term ids: list
+// i of every shard belongs to the same term. A shard with fewer lists
+// contributes nothing to the terms beyond its size. The docids of each
+// shard are shifted by the number of documents of the shards before it.
+
+template <typename Collection>
+struct shard {
+    shard(const char* filename)
+        : m(filename)
+    {
+        succinct::mapper::map(coll, m);
+    }
+
+    boost::iostreams::mapped_file_source m;
+    Collection coll;
+    uint64_t docid_offset;
+};
+
+// The builders may encode a list asynchronously after add_posting_list
+// returns, so the iterators passed to them keep the decoded list alive
+struct merged_list {
+    std::vector<uint64_t> docs;
+    std::vector<uint64_t> freqs;
+    uint64_t occurrences;
+
+    class iterator : public std::iterator<std::forward_iterator_tag,
+                                          uint64_t> {
+    public:
+        iterator(std::shared_ptr<merged_list const> const& list,
+                 uint64_t const* ptr)
+            : m_list(list)
+            , m_ptr(ptr)
+        {}
+
+        uint64_t const& operator*() const
+        {
+            return *m_ptr;
+        }
+
+        iterator& operator++()
+        {
+            ++m_ptr;
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            iterator it(*this);
+            ++m_ptr;
+            return it;
+        }
+
+        bool operator==(iterator const& other) const
+        {
+            return m_ptr == other.m_ptr;
+        }
+
+        bool operator!=(iterator const& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        std::shared_ptr<merged_list const> m_list;
+        uint64_t const* m_ptr;
+    };
+};
+
+template <typename Collection, typename Builder>
+struct list_merger : quasi_succinct::job_pool::job {
+    list_merger(std::vector<std::unique_ptr<shard<Collection>>> const& shards,
+                Builder& builder, size_t term)
+        : shards(shards)
+        , builder(builder)
+        , term(term)
+        , list(std::make_shared<merged_list>())
+    {}
+
+    virtual void prepare()
+    {
+        list->occurrences = 0;
+        for (auto const& s: shards) {
+            if (term >= s->coll.size()) continue;
+            auto e = s->coll[term];
+            for (size_t i = 0; i < e.size(); ++i, e.next()) {
+                uint64_t freq = e.freq();
+                list->docs.push_back(s->docid_offset + e.docid());
+                list->freqs.push_back(freq);
+                list->occurrences += freq;
+            }
+        }
+    }
+
+    virtual void commit()
+    {
+        std::shared_ptr<merged_list const> l = list;
+        list.reset();
+        builder.add_posting_list(l->docs.size(),
+                                 merged_list::iterator(l, l->docs.data()),
+                                 merged_list::iterator(l, l->freqs.data()),
+                                 l->occurrences);
+    }
+
+    std::vector<std::unique_ptr<shard<Collection>>> const& shards;
+    Builder& builder;
+    size_t term;
+    std::shared_ptr<merged_list> list;
+};
+
+template <typename Collection>
+void verify_merge(std::vector<std::unique_ptr<shard<Collection>>> const& shards,
+                  const char* filename)
+{
+    Collection coll;
+    boost::iostreams::mapped_file_source m(filename);
+    succinct::mapper::map(coll, m);
+
+    logger() << "Checking the merged index against the shards..." << std::endl;
+    for (size_t term = 0; term < coll.size(); ++term) {
+        auto merged = coll[term];
+        size_t pos = 0;
+        for (auto const& s: shards) {
+            if (term >= s->coll.size()) continue;
+            auto e = s->coll[term];
+            for (size_t i = 0; i < e.size(); ++i, ++pos, e.next(), merged.next()) {
+                if (pos >= merged.size()
+                    || merged.docid() != s->docid_offset + e.docid()
+                    || merged.freq() != e.freq()) {
+                    logger() << "sequence " << term
+                             << " differs at position " << pos << "!" << std::endl;
+                    exit(1);
+                }
+            }
+        }
+        if (pos != merged.size()) {
+            logger() << "sequence " << term << " has wrong length! ("
+                     << merged.size() << " != " << pos << ")" << std::endl;
+            exit(1);
+        }
+    }
+    logger() << "Everything is OK!" << std::endl;
+}
+
+template <typename Collection>
+void merge_collections(std::vector<const char*> const& input_filenames,
+                       quasi_succinct::global_parameters const& params,
+                       const char* output_filename, bool check,
+                       std::string const& type)
+{
+    using namespace quasi_succinct;
+
+    typedef typename Collection::stream_builder builder_type;
+    typedef list_merger<Collection, builder_type> merger_type;
+
+    std::vector<std::unique_ptr<shard<Collection>>> shards;
+    uint64_t num_docs = 0;
+    size_t num_terms = 0;
+    for (auto filename: input_filenames) {
+        shards.emplace_back(new shard<Collection>(filename));
+        auto& s = *shards.back();
+        s.docid_offset = num_docs;
+        num_docs += s.coll.num_docs();
+        num_terms = std::max(num_terms, size_t(s.coll.size()));
+        logger() << filename << ": " << s.coll.size() << " sequences, "
+                 << s.coll.num_docs() << " documents" << std::endl;
+    }
+
+    double tick = get_time_usecs();
+    double user_tick = get_user_time_usecs();
+
+    // the output is always streamed; QS_BUILD_MEMORY bounds the memory
+    // used by the encoded lists as in create_freq_index
+    size_t build_memory_mb = configuration::get().build_memory_mb;
+    if (!build_memory_mb) build_memory_mb = 1024;
+    size_t max_memory = build_memory_mb << 20;
+    logger() << "Merging " << shards.size() << " shards into "
+             << num_terms << " sequences over " << num_docs
+             << " documents, buffering at most " << build_memory_mb
+             << " MB" << std::endl;
+
+    uint64_t postings = 0;
+    {
+        builder_type builder(num_docs, params, output_filename, max_memory);
+        {
+            // the lists are decoded in parallel; like in the builders each
+            // unit of work (two per posting) takes about 16 bytes
+            size_t threads = std::max<size_t>(1, configuration::get().worker_threads);
+            job_pool pool(std::min(double(1 << 24),
+                                   std::max(1.0, double(max_memory) / 2 / 16 / threads)));
+            for (size_t term = 0; term < num_terms; ++term) {
+                uint64_t n = 0;
+                for (auto const& s: shards) {
+                    if (term < s->coll.size()) n += s->coll[term].size();
+                }
+                postings += n;
+                pool.add_job(std::make_shared<merger_type>(shards, builder, term),
+                             2 * n);
+                if ((term + 1) % 1000000 == 0) {
+                    logger() << "Processed " << term + 1 << " sequences, "
+                             << postings << " postings" << std::endl;
+                }
+            }
+            pool.complete();
+        }
+        builder.build();
+    }
+
+    double elapsed_secs = (get_time_usecs() - tick) / 1000000;
+    double user_elapsed_secs = (get_user_time_usecs() - user_tick) / 1000000;
+    logger() << type << " index merged in "
+             << elapsed_secs << " seconds" << std::endl;
+
+    stats_line()
+        ("type", type)
+        ("shards", shards.size())
+        ("sequences", num_terms)
+        ("postings", postings)
+        ("worker_threads", configuration::get().worker_threads)
+        ("merge_time", elapsed_secs)
+        ("merge_user_time", user_elapsed_secs)
+        ;
+
+    if (check) {
+        verify_merge(shards, output_filename);
+    }
+}
+
+
+int main(int argc, const char** argv) {
+
+    using namespace quasi_succinct;
+
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <index type> <output filename> <shard filename>..."
+                  << " [--check]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::string type = argv[1];
+    const char* output_filename = argv[2];
+    std::vector<const char*> input_filenames;
+    bool check = false;
+    for (int i = 3; i < argc; ++i) {
+        if (std::string(argv[i]) == "--check") {
+            check = true;
+        } else {
+            input_filenames.push_back(argv[i]);
+        }
+    }
+
+    quasi_succinct::global_parameters params;
+    params.log_partition_size = configuration::get().log_partition_size;
+
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                           \
+        } else if (type == BOOST_PP_STRINGIZE(T)) {                     \
+            merge_collections<BOOST_PP_CAT(T, _index)>                  \
+                (input_filenames, params, output_filename, check, type); \
+            /**/
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, QS_INDEX_TYPES);
+#undef LOOP_BODY
+    } else {
+        logger() << "ERROR: Unknown type " << type << std::endl;
+    }
+
+    return 0;
+}
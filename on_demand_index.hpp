@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <succinct/mapper.hpp>
+
+#include "file_reader.hpp"
+#include "list_loader.hpp"
+#include "util.hpp"
+
+namespace quasi_succinct {
+
+    // An index whose posting lists are read from the file when they are
+    // first accessed, and kept in a buffer cache of bounded size with LRU
+    // replacement, so that an index larger than the memory can be queried
+    // without page faults at query time. The file is memory mapped only
+    // to reach the index metadata (the endpoints of the lists), which is
+    // small and stays resident; the pages of the lists are never touched
+    // through the mapping.
+    //
+    // The enumerators keep a reference to the copy of their list, so the
+    // copies in use are not freed when they are evicted. Since they are
+    // not trivially copyable, the index cannot be wrapped in a
+    // cached_index. The reads of the misses of a lookup_batch are
+    // submitted together (see file_reader).
+    template <typename Index>
+    class on_demand_index {
+    public:
+        typedef list_loader<Index> loader;
+        typedef typename loader::list_copy list_copy;
+
+        class document_enumerator : public Index::document_enumerator {
+        public:
+            document_enumerator(typename Index::document_enumerator const& e,
+                                std::shared_ptr<list_copy const> const& copy)
+                : Index::document_enumerator(e)
+                , m_copy(copy)
+            {}
+
+        private:
+            std::shared_ptr<list_copy const> m_copy;
+        };
+
+        on_demand_index(const char* filename, size_t cache_bytes,
+                        bool use_io_uring = true)
+            : m_file(filename)
+            , m_reader(filename, use_io_uring)
+            , m_cache_bytes(cache_bytes)
+            , m_cached_bytes(0)
+            , m_hits(0)
+            , m_misses(0)
+            , m_read_bytes(0)
+        {
+            // the mapping is only used for the metadata, whose pages are
+            // accessed at random
+            madvise(const_cast<char*>(m_file.data()), m_file.size(), MADV_RANDOM);
+            succinct::mapper::map(m_index, m_file);
+        }
+
+        uint64_t size() const
+        {
+            return m_index.size();
+        }
+
+        uint64_t num_docs() const
+        {
+            return m_index.num_docs();
+        }
+
+        bool uses_io_uring() const
+        {
+            return m_reader.uses_io_uring();
+        }
+
+        document_enumerator operator[](size_t term) const
+        {
+            std::vector<document_enumerator> enums;
+            lookup_batch(&term, &term + 1, enums);
+            return enums[0];
+        }
+
+        template <typename TermIterator>
+        void lookup_batch(TermIterator begin, TermIterator end,
+                          std::vector<document_enumerator>& out_enums) const
+        {
+            std::vector<std::shared_ptr<list_copy const>> copies;
+            load(begin, end, copies);
+            for (auto const& copy: copies) {
+                out_enums.push_back(document_enumerator(loader::open(m_index, *copy),
+                                                        copy));
+            }
+        }
+
+        // reads the lists that are not cached, without building the
+        // enumerators
+        template <typename TermIterator>
+        void prefetch(TermIterator begin, TermIterator end) const
+        {
+            std::vector<std::shared_ptr<list_copy const>> copies;
+            load(begin, end, copies);
+        }
+
+        size_t cache_bytes() const
+        {
+            return m_cache_bytes;
+        }
+
+        uint64_t hits() const
+        {
+            return m_hits;
+        }
+
+        uint64_t misses() const
+        {
+            return m_misses;
+        }
+
+        uint64_t read_bytes() const
+        {
+            return m_read_bytes;
+        }
+
+        void reset_stats()
+        {
+            m_hits = 0;
+            m_misses = 0;
+            m_read_bytes = 0;
+        }
+
+    private:
+        typedef std::list<std::pair<uint64_t, std::shared_ptr<list_copy const>>> lru_list;
+
+        template <typename TermIterator>
+        void load(TermIterator begin, TermIterator end,
+                  std::vector<std::shared_ptr<list_copy const>>& copies) const
+        {
+            std::vector<size_t> missed;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (TermIterator it = begin; it != end; ++it) {
+                    uint64_t term = batch_term_id(*it);
+                    assert(term < size());
+                    auto entry = m_entries.find(term);
+                    if (entry != m_entries.end()) {
+                        m_lru.splice(m_lru.begin(), m_lru, entry->second);
+                        copies.push_back(entry->second->second);
+                        ++m_hits;
+                    } else {
+                        missed.push_back(copies.size());
+                        copies.push_back(nullptr);
+                        ++m_misses;
+                    }
+                }
+            }
+            if (missed.empty()) return;
+
+            // the reads of all the missed lists are submitted together
+            std::vector<std::shared_ptr<list_copy>> new_copies(missed.size());
+            std::vector<file_reader::request> reqs(missed.size() * loader::parts);
+            std::vector<uint64_t> terms(missed.size());
+            TermIterator it = begin;
+            size_t pos = 0;
+            for (size_t i = 0; i < missed.size(); ++i) {
+                for (; pos < missed[i]; ++pos) ++it;
+                terms[i] = batch_term_id(*it);
+                new_copies[i] = std::make_shared<list_copy>();
+                loader::plan(m_index, terms[i], m_file.data(), *new_copies[i],
+                             &reqs[i * loader::parts]);
+            }
+            m_reader.read(reqs.data(), reqs.size());
+            for (size_t i = 0; i < missed.size(); ++i) {
+                loader::finish(*new_copies[i]);
+                copies[missed[i]] = new_copies[i];
+                m_read_bytes += new_copies[i]->bytes();
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t i = 0; i < missed.size(); ++i) {
+                insert(terms[i], new_copies[i]);
+            }
+        }
+
+        void insert(uint64_t term, std::shared_ptr<list_copy const> const& copy) const
+        {
+            if (m_entries.count(term)) return; // loaded by another thread
+            size_t bytes = copy->bytes();
+            if (bytes > m_cache_bytes) return;
+            while (m_cached_bytes + bytes > m_cache_bytes) {
+                m_cached_bytes -= m_lru.back().second->bytes();
+                m_entries.erase(m_lru.back().first);
+                m_lru.pop_back();
+            }
+            m_lru.emplace_front(term, copy);
+            m_entries[term] = m_lru.begin();
+            m_cached_bytes += bytes;
+        }
+
+        boost::iostreams::mapped_file_source m_file;
+        Index m_index;
+        file_reader m_reader;
+        size_t m_cache_bytes;
+
+        mutable std::mutex m_mutex;
+        mutable lru_list m_lru;
+        mutable std::unordered_map<uint64_t, typename lru_list::iterator> m_entries;
+        mutable size_t m_cached_bytes;
+        mutable std::atomic<uint64_t> m_hits;
+        mutable std::atomic<uint64_t> m_misses;
+        mutable std::atomic<uint64_t> m_read_bytes;
+    };
+
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <iterator>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+#include <utility>
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -10,12 +15,65 @@ namespace quasi_succinct {
     typedef uint32_t posting_t ;
     typedef uint64_t cost_t;
 
+    // Totals of the chunked construction of optimal_partition over all the
+    // lists built by the process
+    struct chunked_partition_stats {
+        static chunked_partition_stats& get()
+        {
+            static chunked_partition_stats instance;
+            return instance;
+        }
+
+        std::atomic<uint64_t> lists;
+        std::atomic<uint64_t> boundaries;
+        std::atomic<uint64_t> kept_boundaries;
+        std::atomic<uint64_t> cost;
+        std::atomic<uint64_t> boundary_cost;
+
+    private:
+        chunked_partition_stats()
+            : lists(0)
+            , boundaries(0)
+            , kept_boundaries(0)
+            , cost(0)
+            , boundary_cost(0)
+        {}
+    };
+
+    // A cost function is called as cost_fun(universe, n), or as
+    // cost_fun(universe, n, max_gap) if it takes the largest gap minus one
+    // of the partition, for base sequences whose size depends on it
+    template <typename CostFunction>
+    struct takes_max_gap {
+        template <typename F>
+        static char test(decltype(std::declval<F&>()(uint64_t(), uint64_t(), uint64_t()))*);
+        template <typename F>
+        static int test(...);
+
+        static const bool value = sizeof(test<CostFunction>(nullptr)) == sizeof(char);
+    };
+
     struct optimal_partition {
 
         std::vector<posting_t> partition;
         cost_t cost_opt = 0; // the costs are in bits!
+        cost_t boundary_cost = 0; // only set by the chunked construction
 
-        template <typename ForwardIterator>
+        typedef std::pair<posting_t, uint64_t> position_gap;
+
+        // stands in for the deque of gaps when they are not tracked: a
+        // std::deque allocates when it is constructed, which is a large
+        // part of the time spent on a short list
+        struct no_gaps {
+            bool empty() const { return true; }
+            position_gap front() const { return position_gap(); }
+            position_gap back() const { return position_gap(); }
+            void pop_front() {}
+            void pop_back() {}
+            void emplace_back(posting_t, uint64_t) {}
+        };
+
+        template <typename ForwardIterator, bool TrackGaps = false>
         struct cost_window {
             // a window reppresent the cost of the interval [start, end)
 
@@ -29,10 +87,16 @@ namespace quasi_succinct {
 
             cost_t cost_upper_bound; // The maximum cost for this window
 
-            cost_window(ForwardIterator begin, cost_t cost_upper_bound)
+            // with TrackGaps, the (position, gap) pairs that can still be
+            // the largest gap of the window, with decreasing gaps
+            typename std::conditional<TrackGaps, std::deque<position_gap>,
+                                      no_gaps>::type gaps;
+
+            cost_window(ForwardIterator begin, uint64_t base,
+                        cost_t cost_upper_bound)
                 : start_it(begin)
                 , end_it(begin)
-                , min_p(*begin)
+                , min_p(base)
                 , max_p(0)
                 , cost_upper_bound(cost_upper_bound)
             {}
@@ -47,8 +111,16 @@ namespace quasi_succinct {
                 return end - start;
             }
 
+            uint64_t max_gap() const
+            {
+                return gaps.empty() ? 0 : gaps.front().second;
+            }
+
             void advance_start()
             {
+                if (TrackGaps && !gaps.empty() && gaps.front().first == start) {
+                    gaps.pop_front();
+                }
                 min_p = *start_it + 1;
                 ++start;
                 ++start_it;
@@ -56,6 +128,15 @@ namespace quasi_succinct {
 
             void advance_end()
             {
+                if (TrackGaps) {
+                    // the value before end is max_p, or min_p - 1 if the
+                    // window is empty
+                    uint64_t gap = *end_it - (end > start ? max_p + 1 : min_p);
+                    while (!gaps.empty() && gaps.back().second <= gap) {
+                        gaps.pop_back();
+                    }
+                    gaps.emplace_back(end, gap);
+                }
                 max_p = *end_it;
                 ++end;
                 ++end_it;
@@ -70,21 +151,224 @@ namespace quasi_succinct {
         optimal_partition(ForwardIterator begin, uint64_t universe, uint64_t size,
                           CostFunction cost_fun, double eps1, double eps2)
         {
-            cost_t single_block_cost = cost_fun(universe, size);
-            std::vector<cost_t> min_cost(size+1, single_block_cost);
-            min_cost[0] = 0;
+            cost_opt = optimize(begin, *begin, universe, size,
+                                cost_fun, eps1, eps2, partition);
+        }
+
+        // Sequences longer than chunk_size are split into chunks that are
+        // partitioned independently on up to num_threads threads; the
+        // neighbourhood of each chunk boundary is then re-optimized so
+        // that partitions can cross it. The cuts that survive the repair
+        // are charged one minimum partition cost each in boundary_cost,
+        // an estimate of the gap from the unconstrained optimum.
+        template <typename ForwardIterator, typename CostFunction>
+        optimal_partition(ForwardIterator begin, uint64_t universe, uint64_t size,
+                          CostFunction cost_fun, double eps1, double eps2,
+                          uint64_t chunk_size, size_t num_threads)
+        {
+            if (!chunk_size || size <= chunk_size) {
+                cost_opt = optimize(begin, *begin, universe, size,
+                                    cost_fun, eps1, eps2, partition);
+                return;
+            }
+
+            struct chunk {
+                ForwardIterator begin;
+                uint64_t first;
+                uint64_t size;
+                uint64_t base;
+                uint64_t universe;
+                std::vector<posting_t> partition;
+                cost_t cost;
+            };
+
+            std::vector<chunk> chunks;
+            {
+                ForwardIterator it = begin;
+                uint64_t prev = 0;
+                for (uint64_t first = 0; first < size; first += chunk_size) {
+                    uint64_t chunk_len = std::min(chunk_size, size - first);
+                    uint64_t base = first ? prev + 1 : *it;
+                    chunks.push_back(chunk { it, first, chunk_len, base, 0, {}, 0 });
+                    for (uint64_t i = 0; i < chunk_len; ++i, ++it) {
+                        prev = *it;
+                    }
+                    chunks.back().universe = (first + chunk_len == size)
+                        ? universe - base : prev - base + 1;
+                }
+            }
+
+            std::atomic<size_t> next_chunk(0);
+            auto worker = [&]() {
+                size_t c;
+                while ((c = next_chunk++) < chunks.size()) {
+                    auto& ch = chunks[c];
+                    ch.cost = optimize(ch.begin, ch.base, ch.universe, ch.size,
+                                       cost_fun, eps1, eps2, ch.partition);
+                }
+            };
+            std::vector<std::thread> threads;
+            for (size_t t = 1; t < std::min(num_threads, chunks.size()); ++t) {
+                threads.emplace_back(worker);
+            }
+            worker();
+            for (auto& t: threads) {
+                t.join();
+            }
+
+            for (auto const& ch: chunks) {
+                for (auto p: ch.partition) {
+                    partition.push_back(posting_t(ch.first + p));
+                }
+                cost_opt += ch.cost;
+            }
+
+            std::vector<uint64_t> values;
+            std::vector<posting_t> window_partition;
+            for (size_t c = 1; c < chunks.size(); ++c) {
+                posting_t boundary = posting_t(chunks[c].first);
+                auto cut = std::lower_bound(partition.begin(), partition.end(), boundary);
+                // a previous repair may already have removed the cut
+                if (*cut != boundary) continue;
+
+                size_t k = size_t(cut - partition.begin());
+                uint64_t a = k > repair_partitions
+                    ? partition[k - repair_partitions - 1] : 0;
+                size_t b_idx = std::min(k + repair_partitions, partition.size() - 1);
+                uint64_t b = partition[b_idx];
+
+                // read the window [a, b) and the value preceding it
+                auto const& ch = chunks[(a ? a - 1 : 0) / chunk_size];
+                ForwardIterator it = std::next(ch.begin, (a ? a - 1 : 0) - ch.first);
+                uint64_t base = a ? *it++ + 1 : *it;
+                values.clear();
+                for (uint64_t i = a; i < b; ++i, ++it) {
+                    values.push_back(*it);
+                }
+
+                cost_t old_cost = 0;
+                uint64_t cur_begin = a, cur_base = base;
+                for (size_t p = (a ? std::lower_bound(partition.begin(), partition.end(), a)
+                                 - partition.begin() + 1 : 0);
+                     p <= b_idx; ++p) {
+                    uint64_t last = values[partition[p] - 1 - a];
+                    uint64_t max_gap = 0;
+                    if (takes_max_gap<CostFunction>::value) {
+                        uint64_t next = cur_base;
+                        for (uint64_t i = cur_begin; i < partition[p]; ++i) {
+                            max_gap = std::max(max_gap, values[i - a] - next);
+                            next = values[i - a] + 1;
+                        }
+                    }
+                    old_cost += cost(cost_fun, last - cur_base + 1,
+                                     partition[p] - cur_begin, max_gap);
+                    cur_begin = partition[p];
+                    cur_base = last + 1;
+                }
+
+                window_partition.clear();
+                cost_t new_cost = optimize(values.begin(), base, values.back() - base + 1,
+                                           b - a, cost_fun, eps1, eps2, window_partition);
+                if (new_cost < old_cost) {
+                    auto first_it = (a ? std::lower_bound(partition.begin(), partition.end(), a) + 1
+                                     : partition.begin());
+                    auto last_it = partition.begin() + b_idx + 1;
+                    for (auto& p: window_partition) {
+                        p += posting_t(a);
+                    }
+                    auto pos = partition.erase(first_it, last_it);
+                    partition.insert(pos, window_partition.begin(), window_partition.end());
+                    cost_opt = cost_opt - old_cost + new_cost;
+                }
+            }
+
+            uint64_t kept_cuts = 0;
+            for (size_t c = 1; c < chunks.size(); ++c) {
+                kept_cuts += std::binary_search(partition.begin(), partition.end(),
+                                                posting_t(chunks[c].first));
+            }
+            boundary_cost = kept_cuts * cost(cost_fun, 1, 1, 0);
+
+            auto& stats = chunked_partition_stats::get();
+            stats.lists += 1;
+            stats.boundaries += chunks.size() - 1;
+            stats.kept_boundaries += kept_cuts;
+            stats.cost += cost_opt;
+            stats.boundary_cost += boundary_cost;
+        }
+
+    private:
+
+        struct optimize_workspace {
+            std::vector<cost_t> min_cost;
+            std::vector<posting_t> path;
+        };
+
+        // number of partitions on each side of a chunk boundary that are
+        // re-optimized together with it
+        static const size_t repair_partitions = 4;
+
+        template <typename CostFunction>
+        static cost_t cost(CostFunction& cost_fun, uint64_t universe, uint64_t n,
+                           uint64_t max_gap)
+        {
+            return cost(cost_fun, universe, n, max_gap,
+                        std::integral_constant<bool, takes_max_gap<CostFunction>::value>());
+        }
+
+        template <typename CostFunction>
+        static cost_t cost(CostFunction& cost_fun, uint64_t universe, uint64_t n,
+                           uint64_t max_gap, std::true_type)
+        {
+            return cost_fun(universe, n, max_gap);
+        }
+
+        template <typename CostFunction>
+        static cost_t cost(CostFunction& cost_fun, uint64_t universe, uint64_t n,
+                           uint64_t /* max_gap */, std::false_type)
+        {
+            return cost_fun(universe, n);
+        }
+
+        template <typename ForwardIterator, typename CostFunction>
+        static cost_t optimize(ForwardIterator begin, uint64_t base,
+                               uint64_t universe, uint64_t size,
+                               CostFunction cost_fun, double eps1, double eps2,
+                               std::vector<posting_t>& partition)
+        {
+            static const bool track_gaps = takes_max_gap<CostFunction>::value;
+            typedef cost_window<ForwardIterator, track_gaps> window_type;
+
+            uint64_t max_gap = 0;
+            if (track_gaps) {
+                uint64_t next = base;
+                ForwardIterator it = begin;
+                for (uint64_t i = 0; i < size; ++i, ++it) {
+                    max_gap = std::max<uint64_t>(max_gap, *it - next);
+                    next = *it + 1;
+                }
+            }
+            cost_t single_block_cost = cost(cost_fun, universe, size, max_gap);
+
+            // most lists are short, so the buffers are kept across the
+            // calls of the thread instead of allocated for each list
+            static thread_local optimize_workspace ws;
+            ws.min_cost.assign(size + 1, single_block_cost);
+            ws.min_cost[0] = 0;
+            ws.path.assign(size + 1, 0);
+            cost_t* min_cost = ws.min_cost.data();
+            posting_t* path = ws.path.data();
 
             // create the required window: one for each power of approx_factor
-            std::vector<cost_window<ForwardIterator>> windows;
-            cost_t cost_lb = cost_fun(1, 1); // minimum cost
+            std::vector<window_type> windows;
+            cost_t cost_lb = cost(cost_fun, 1, 1, 0); // minimum cost
             cost_t cost_bound = cost_lb;
             while (eps1 == 0 || cost_bound < cost_lb / eps1) {
-                windows.emplace_back(begin, cost_bound);
+                windows.emplace_back(begin, base, cost_bound);
                 if (cost_bound >= single_block_cost) break;
                 cost_bound = cost_bound * (1 + eps2);
             }
 
-            std::vector<posting_t> path(size + 1, 0);
             for (posting_t i = 0; i < size; i++) {
                 size_t last_end = i + 1;
                 for (auto& window: windows) {
@@ -96,7 +380,8 @@ namespace quasi_succinct {
 
                     cost_t window_cost;
                     while (true) {
-                        window_cost = cost_fun(window.universe(), window.size());
+                        window_cost = cost(cost_fun, window.universe(), window.size(),
+                                           window.max_gap());
                         if ((min_cost[i] + window_cost < min_cost[window.end])) {
                             min_cost[window.end] = min_cost[i] + window_cost;
                             path[window.end] = i;
@@ -111,13 +396,14 @@ namespace quasi_succinct {
                 }
             }
 
+            size_t first = partition.size();
             posting_t curr_pos = size;
             while( curr_pos != 0 ) {
                 partition.push_back(curr_pos);
                 curr_pos = path[curr_pos];
             }
-            std::reverse(partition.begin(), partition.end());
-            cost_opt = min_cost[size];
+            std::reverse(partition.begin() + first, partition.end());
+            return min_cost[size];
         }
     };
 
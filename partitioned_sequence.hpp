@@ -1,6 +1,8 @@
 #pragma once
 
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 #include "configuration.hpp"
 #include "global_parameters.hpp"
@@ -25,13 +27,9 @@ namespace quasi_succinct {
                           global_parameters const& params)
         {
             assert(n > 0);
-            auto const& conf = configuration::get();
-
-            auto cost_fun = [&](uint64_t universe, uint64_t n) {
-                return base_sequence_type::bitsize(params, universe, n) + conf.fix_cost;
-            };
-
-            optimal_partition opt(begin, universe, n, cost_fun, conf.eps1, conf.eps2);
+            optimal_partition opt = partition(
+                begin, universe, n, params,
+                std::integral_constant<bool, has_max_gap_bitsize<base_sequence_type>::value>());
 
             size_t partitions = opt.partition.size();
             assert(partitions > 0);
@@ -119,6 +117,54 @@ namespace quasi_succinct {
             }
         }
 
+    private:
+        // whether the size of BaseSequence depends on the largest gap, as
+        // for bitpacked_indexed_sequence
+        template <typename Sequence>
+        struct has_max_gap_bitsize {
+            template <typename S>
+            static char test(decltype(S::bitsize(std::declval<global_parameters const&>(),
+                                                 uint64_t(), uint64_t(), uint64_t()))*);
+            template <typename S>
+            static int test(...);
+
+            static const bool value = sizeof(test<Sequence>(nullptr)) == sizeof(char);
+        };
+
+        // the cost of a partition is its size in bits plus, with a
+        // QS_SPEED_LAMBDA, its decode_cost
+
+        template <typename Iterator>
+        static optimal_partition partition(Iterator begin, uint64_t universe, uint64_t n,
+                                           global_parameters const& params,
+                                           std::false_type)
+        {
+            auto const& conf = configuration::get();
+            auto cost_fun = [&](uint64_t universe, uint64_t n) {
+                return base_sequence_type::best_type(params, universe, n,
+                                                     conf.speed_lambda).second
+                    + conf.fix_cost;
+            };
+            return optimal_partition(begin, universe, n, cost_fun, conf.eps1, conf.eps2,
+                                     conf.partition_chunk_size, conf.worker_threads);
+        }
+
+        template <typename Iterator>
+        static optimal_partition partition(Iterator begin, uint64_t universe, uint64_t n,
+                                           global_parameters const& params,
+                                           std::true_type)
+        {
+            auto const& conf = configuration::get();
+            auto cost_fun = [&](uint64_t universe, uint64_t n, uint64_t max_gap) {
+                return base_sequence_type::best_type(params, universe, n, max_gap,
+                                                     conf.speed_lambda).second
+                    + conf.fix_cost;
+            };
+            return optimal_partition(begin, universe, n, cost_fun, conf.eps1, conf.eps2,
+                                     conf.partition_chunk_size, conf.worker_threads);
+        }
+
+    public:
         class enumerator {
         public:
 
@@ -235,6 +281,31 @@ namespace quasi_succinct {
                 return m_partitions;
             }
 
+            // note: this is instantiated only if BaseSequence has decode_range
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+                move(position);
+
+                while (true) {
+                    uint64_t partition_count = std::min(count, m_cur_end - m_position);
+                    m_partition_enum.decode_range(m_position - m_cur_begin,
+                                                  partition_count, out);
+                    uint32_t base = uint32_t(m_cur_base);
+                    for (uint64_t i = 0; i < partition_count; ++i) {
+                        out[i] += base;
+                    }
+                    // leave the enumerator on the last decoded value
+                    m_position += partition_count - 1;
+                    count -= partition_count;
+                    out += partition_count;
+                    if (!count) break;
+
+                    m_position += 1;
+                    switch_partition(m_cur_partition + 1);
+                }
+            }
+
             friend class partitioned_sequence_test;
 
         private:
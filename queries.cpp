@@ -1,8 +1,14 @@
 #include <iostream>
+#include <thread>
+#include <atomic>
 
 #include <succinct/mapper.hpp>
 
+#include "cached_index.hpp"
+#include "configuration.hpp"
 #include "index_types.hpp"
+#include "loaded_index.hpp"
+#include "on_demand_index.hpp"
 #include "wand_data.hpp"
 #include "queries.hpp"
 #include "util.hpp"
@@ -19,9 +25,25 @@ void op_perftest(IndexType const& index,
 
     std::vector<double> query_times;
 
+    // with a prefetch depth d, before query i is evaluated the lists of
+    // query i + d are looked up and their headers prefetched, so that
+    // the cache misses of the lookup overlap with the evaluation of the
+    // queries in between
+    size_t depth = configuration::get().query_prefetch_depth;
+    auto prefetch_query = [&](size_t i) {
+        if (depth && i < queries.size()) {
+            index.prefetch(queries[i].begin(), queries[i].end());
+        }
+    };
+
     for (size_t run = 0; run <= runs; ++run) {
-        for (auto const& query: queries) {
+        for (size_t i = 0; i < depth; ++i) {
+            prefetch_query(i);
+        }
+        for (size_t i = 0; i < queries.size(); ++i) {
+            auto const& query = queries[i];
             auto tick = get_time_usecs();
+            prefetch_query(i + depth);
             uint64_t result = query_op(index, query);
             do_not_optimize_away(result);
             double elapsed = double(get_time_usecs() - tick);
@@ -54,8 +76,222 @@ void op_perftest(IndexType const& index,
             ("q50", q50)
             ("q90", q90)
             ("q95", q95)
+            ("prefetch_depth", depth)
+            ;
+    }
+}
+
+
+template <typename QueryOperatorFactory, typename IndexType>
+void op_throughput_test(IndexType const& index,
+                        QueryOperatorFactory make_query_op,
+                        std::vector<quasi_succinct::term_id_vec> const& queries,
+                        std::string const& index_type,
+                        std::string const& query_type,
+                        size_t threads,
+                        size_t runs)
+{
+    using namespace quasi_succinct;
+
+    // with a NUMA mode the workers are spread round-robin over the nodes
+    std::string const& numa_mode = configuration::get().numa_mode;
+    std::vector<std::vector<double>> query_times(threads);
+    double elapsed_usecs = 0;
+    size_t total_queries = 0;
+
+    for (size_t run = 0; run <= runs; ++run) {
+        // the queries are never modified, so a shared atomic cursor is
+        // enough to hand them out to the workers without locking
+        std::atomic<size_t> next_query(0);
+        bool timed = run != 0; // first run is not timed
+
+        std::vector<std::thread> workers;
+        auto tick = get_time_usecs();
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                    if (numa_mode != "none") {
+                        numa::pin_thread(t % numa::num_nodes());
+                    }
+                    auto query_op = make_query_op();
+                    while (true) {
+                        size_t i = next_query.fetch_add(1, std::memory_order_relaxed);
+                        if (i >= queries.size()) break;
+                        auto query_tick = get_time_usecs();
+                        uint64_t result = query_op(index, queries[i]);
+                        do_not_optimize_away(result);
+                        double elapsed = double(get_time_usecs() - query_tick);
+                        if (timed) {
+                            query_times[t].push_back(elapsed);
+                        }
+                    }
+                });
+        }
+        for (auto& w: workers) {
+            w.join();
+        }
+
+        if (timed) {
+            elapsed_usecs += get_time_usecs() - tick;
+            total_queries += queries.size();
+        }
+    }
+
+    auto quantile = [](std::vector<double> const& times, size_t q) {
+        return times.empty() ? 0. : times[q * times.size() / 100];
+    };
+
+    double qps = total_queries / (elapsed_usecs / 1000000);
+    logger() << "---- " << index_type << " " << query_type
+             << " (" << threads << " threads)" << std::endl;
+    logger() << "Throughput: " << qps << " queries/s" << std::endl;
+
+    for (size_t t = 0; t < threads; ++t) {
+        auto& times = query_times[t];
+        std::sort(times.begin(), times.end());
+        stats_line()
+            ("type", index_type)
+            ("query", query_type)
+            ("thread", t)
+            ("queries", times.size())
+            ("q50", quantile(times, 50))
+            ("q90", quantile(times, 90))
+            ("q99", quantile(times, 99))
             ;
     }
+
+    stats_line()
+        ("type", index_type)
+        ("query", query_type)
+        ("threads", threads)
+        ("qps", qps)
+        ;
+}
+
+
+template <typename IndexType>
+void dump_cache_stats(IndexType const&, std::string const&, std::string const&)
+{}
+
+template <typename IndexType>
+void dump_cache_stats(quasi_succinct::cached_index<IndexType> const& index,
+                      std::string const& index_type,
+                      std::string const& query_type)
+{
+    using namespace quasi_succinct;
+
+    uint64_t hits = index.hits();
+    uint64_t misses = index.misses();
+    double hit_rate = (hits + misses) ? double(hits) / (hits + misses) : 0;
+    logger() << "Term cache: " << hits << " hits, " << misses << " misses ("
+             << hit_rate * 100 << "% hit rate)" << std::endl;
+
+    stats_line()
+        ("type", index_type)
+        ("query", query_type)
+        ("term_cache_size", index.capacity())
+        ("term_cache_hits", hits)
+        ("term_cache_misses", misses)
+        ("term_cache_hit_rate", hit_rate)
+        ;
+
+    // the statistics are per query type, but the cache stays warm
+    const_cast<cached_index<IndexType>&>(index).reset_stats();
+}
+
+
+template <typename IndexType>
+void dump_cache_stats(quasi_succinct::on_demand_index<IndexType> const& index,
+                      std::string const& index_type,
+                      std::string const& query_type)
+{
+    using namespace quasi_succinct;
+
+    uint64_t hits = index.hits();
+    uint64_t misses = index.misses();
+    double hit_rate = (hits + misses) ? double(hits) / (hits + misses) : 0;
+    logger() << "List cache: " << hits << " hits, " << misses << " misses ("
+             << hit_rate * 100 << "% hit rate), "
+             << index.read_bytes() << " bytes read" << std::endl;
+
+    stats_line()
+        ("type", index_type)
+        ("query", query_type)
+        ("list_cache_bytes", index.cache_bytes())
+        ("list_cache_hits", hits)
+        ("list_cache_misses", misses)
+        ("list_cache_hit_rate", hit_rate)
+        ("list_read_bytes", index.read_bytes())
+        ("io_uring", index.uses_io_uring())
+        ;
+
+    const_cast<on_demand_index<IndexType>&>(index).reset_stats();
+}
+
+
+template <typename QueryOperatorFactory, typename IndexType>
+void run_query_type(IndexType const& index,
+                    QueryOperatorFactory make_query_op,
+                    std::vector<quasi_succinct::term_id_vec> const& queries,
+                    std::string const& index_type,
+                    std::string const& query_type,
+                    size_t runs)
+{
+    size_t threads = quasi_succinct::configuration::get().query_threads;
+    if (threads) {
+        op_throughput_test(index, make_query_op, queries,
+                           index_type, query_type, threads, runs);
+    } else {
+        op_perftest(index, make_query_op(), queries,
+                    index_type, query_type, runs);
+    }
+    dump_cache_stats(index, index_type, query_type);
+}
+
+
+template <typename IndexType>
+struct query_type_runner {
+    IndexType const& index;
+    std::vector<quasi_succinct::term_id_vec> const& queries;
+    std::string const& type;
+
+    template <typename QueryOperatorFactory>
+    void operator()(std::string const& query_type,
+                    QueryOperatorFactory make_query_op, size_t runs) const
+    {
+        run_query_type(index, make_query_op, queries, type, query_type, runs);
+    }
+};
+
+
+template <typename IndexType>
+void run_queries(IndexType const& index,
+                 quasi_succinct::wand_data<> const* wdata,
+                 std::vector<quasi_succinct::term_id_vec> const& queries,
+                 std::string const& type)
+{
+    using namespace quasi_succinct;
+
+    logger() << "Performing " << type << " queries" << std::endl;
+    query_type_runner<IndexType> runner = {index, queries, type};
+    for_each_query_type(wdata, configuration::get().query_shards, runner);
+}
+
+
+template <typename IndexType>
+void on_demand_perftest(const char* index_filename,
+                        quasi_succinct::wand_data<> const* wdata,
+                        std::vector<quasi_succinct::term_id_vec> const& queries,
+                        std::string const& type)
+{
+    using namespace quasi_succinct;
+
+    size_t cache_mb = configuration::get().list_cache_mb;
+    on_demand_index<IndexType> index(index_filename, cache_mb << 20,
+                                     configuration::get().use_io_uring);
+    logger() << "Reading the lists on demand "
+             << (index.uses_io_uring() ? "with io_uring" : "with pread")
+             << ", caching up to " << cache_mb << " MB" << std::endl;
+    run_queries(index, wdata, queries, type);
 }
 
 
@@ -67,27 +303,76 @@ void perftest(const char* index_filename,
 {
     using namespace quasi_succinct;
 
-    IndexType index;
-    logger() << "Loading index from " << index_filename << std::endl;
-    boost::iostreams::mapped_file_source m(index_filename);
-    succinct::mapper::map(index, m, succinct::mapper::map_flags::warmup);
-
-    logger() << "Performing " << type << " queries" << std::endl;
-    op_perftest(index, and_query<false>(), queries, type, "and", 3);
-    op_perftest(index, and_query<true>(), queries, type, "and_freq", 3);
-    op_perftest(index, or_query<false>(), queries, type, "or", 1);
-    op_perftest(index, or_query<true>(), queries, type, "or_freq", 1);
-
+    wand_data<> wdata;
+    boost::iostreams::mapped_file_source md;
     if (wand_data_filename) {
-        wand_data<> wdata;
-        boost::iostreams::mapped_file_source md(wand_data_filename);
+        md.open(wand_data_filename);
         succinct::mapper::map(wdata, md, succinct::mapper::map_flags::warmup);
-        op_perftest(index, ranked_and_query(wdata, 10), queries, type, "ranked_and", 3);
-        op_perftest(index, ranked_or_query(wdata, 10), queries, type, "ranked_or", 1);
-        op_perftest(index, wand_query(wdata, 10), queries, type, "wand", 1);
-        op_perftest(index, maxscore_query(wdata, 10), queries, type, "maxscore", 1);
+    }
+    wand_data<> const* wdata_ptr = wand_data_filename ? &wdata : nullptr;
+
+    std::string const& load_mode = configuration::get().load_mode;
+    if (load_mode == "on_demand") {
+        on_demand_perftest<IndexType>(index_filename, wdata_ptr, queries, type);
+        return;
+    }
+
+    std::string const& numa_mode = configuration::get().numa_mode;
+    logger() << "Loading index from " << index_filename
+             << " (load mode " << load_mode
+             << ", NUMA mode " << numa_mode << ")" << std::endl;
+    size_t warmup_threads = configuration::get().warmup_threads;
+    std::string const& hot_terms_file = configuration::get().hot_terms_file;
+    std::vector<uint64_t> hot_terms;
+    if (!hot_terms_file.empty()) {
+        hot_terms = read_hot_terms(hot_terms_file.c_str());
+        logger() << "Paging in only the lists of the " << hot_terms.size()
+                 << " terms in " << hot_terms_file << std::endl;
     }
 
+    double tick = get_time_usecs();
+    loaded_index<IndexType> index(index_filename, load_mode, numa_mode,
+                                  warmup_threads,
+                                  hot_terms_file.empty() ? nullptr : &hot_terms);
+    double load_secs = (get_time_usecs() - tick) / 1000000;
+    logger() << "Index loaded in " << load_secs << " seconds with "
+             << warmup_threads << " threads, backed by "
+             << index.memory().backing() << std::endl;
+    stats_line()
+        ("type", type)
+        ("load_mode", load_mode)
+        ("numa_mode", numa_mode)
+        ("numa_nodes", numa::num_nodes())
+        ("backing", index.memory().backing())
+        ("warmup_threads", warmup_threads)
+        ("hot_terms", hot_terms.size())
+        ("load_time", load_secs)
+        ;
+    if (numa_mode != "none") {
+        numa::pin_thread(0);
+    }
+
+    std::string const& record_file = configuration::get().record_hot_terms_file;
+    if (!record_file.empty()) {
+        index.record_accesses();
+    }
+
+    size_t term_cache_size = configuration::get().term_cache_size;
+    if (term_cache_size) {
+        logger() << "Caching the enumerators of up to "
+                 << term_cache_size << " terms" << std::endl;
+        cached_index<loaded_index<IndexType>> cached(index, term_cache_size);
+        run_queries(cached, wdata_ptr, queries, type);
+    } else {
+        run_queries(index, wdata_ptr, queries, type);
+    }
+
+    if (!record_file.empty()) {
+        auto terms = index.accessed_terms();
+        write_hot_terms(record_file.c_str(), terms);
+        logger() << "Wrote the " << terms.size() << " accessed terms to "
+                 << record_file << std::endl;
+    }
 }
 
 int main(int argc, const char** argv)
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <limits>
 
 #include "index_types.hpp"
 #include "wand_data.hpp"
@@ -45,9 +48,7 @@ namespace quasi_succinct {
             std::vector<enum_type> enums;
             enums.reserve(terms.size());
 
-            for (auto term: terms) {
-                enums.push_back(index[term]);
-            }
+            index.lookup_batch(terms.begin(), terms.end(), enums);
 
             // sort by increasing frequency
             std::sort(enums.begin(), enums.end(),
@@ -98,9 +99,7 @@ namespace quasi_succinct {
             std::vector<enum_type> enums;
             enums.reserve(terms.size());
 
-            for (auto term: terms) {
-                enums.push_back(index[term]);
-            }
+            index.lookup_batch(terms.begin(), terms.end(), enums);
 
             uint64_t results = 0;
             uint64_t cur_doc = std::min_element(enums.begin(), enums.end(),
@@ -150,21 +149,27 @@ namespace quasi_succinct {
     }
 
     struct topk_queue {
+        typedef std::pair<float, uint64_t> entry_type; // (score, docid)
+
+        static const bool is_shared = false;
+
         topk_queue(uint64_t k)
             : m_k(k)
-        {}
+        {
+            m_q.reserve(k);
+        }
 
-        bool insert(float score)
+        bool insert(float score, uint64_t docid)
         {
             if (m_q.size() < m_k) {
-                m_q.push_back(score);
-                std::push_heap(m_q.begin(), m_q.end(), std::greater<float>());
+                m_q.emplace_back(score, docid);
+                std::push_heap(m_q.begin(), m_q.end(), min_heap_order);
                 return true;
             } else {
-                if (score > m_q.front()) {
-                    std::pop_heap(m_q.begin(), m_q.end(), std::greater<float>());
-                    m_q.back() = score;
-                    std::push_heap(m_q.begin(), m_q.end(), std::greater<float>());
+                if (score > m_q.front().first) {
+                    std::pop_heap(m_q.begin(), m_q.end(), min_heap_order);
+                    m_q.back() = entry_type(score, docid);
+                    std::push_heap(m_q.begin(), m_q.end(), min_heap_order);
                     return true;
                 }
             }
@@ -173,15 +178,29 @@ namespace quasi_succinct {
 
         bool would_enter(float score) const
         {
-            return m_q.size() < m_k || score > m_q.front();
+            return m_q.size() < m_k || score > m_q.front().first;
+        }
+
+        bool full() const
+        {
+            return m_q.size() == m_k;
+        }
+
+        // lowest score in the queue; only valid when full() and before
+        // finalize()
+        float threshold() const
+        {
+            assert(full());
+            return m_q.front().first;
         }
 
         void finalize()
         {
-            std::sort_heap(m_q.begin(), m_q.end(), std::greater<float>());
+            std::sort_heap(m_q.begin(), m_q.end(), min_heap_order);
         }
 
-        std::vector<float> const& topk() const
+        // sorted by decreasing score after finalize()
+        std::vector<entry_type> const& topk() const
         {
             return m_q;
         }
@@ -192,8 +211,15 @@ namespace quasi_succinct {
         }
 
     private:
+        // only the score takes part in the comparison, so the heap
+        // operations cost the same as with bare floats
+        static bool min_heap_order(entry_type const& lhs, entry_type const& rhs)
+        {
+            return lhs.first > rhs.first;
+        }
+
         uint64_t m_k;
-        std::vector<float> m_q;
+        std::vector<entry_type> m_q;
     };
 
 
@@ -225,8 +251,14 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
-            for (auto term: query_term_freqs) {
-                auto list = index[term.first];
+            std::vector<enum_type> lists;
+            lists.reserve(query_term_freqs.size());
+            index.lookup_batch(query_term_freqs.begin(), query_term_freqs.end(),
+                               lists);
+
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                auto const& term = query_term_freqs[i];
+                auto& list = lists[i];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
                 auto max_weight = q_weight * m_wdata.max_term_weight(term.first);
@@ -283,7 +315,7 @@ namespace quasi_succinct {
                         en->docs_enum.next();
                     }
 
-                    m_topk.insert(score);
+                    m_topk.insert(score, pivot_id);
                     // resort by docid
                     sort_enums();
                 } else {
@@ -308,7 +340,188 @@ namespace quasi_succinct {
             return m_topk.topk().size();
         }
 
-        std::vector<float> const& topk() const
+        std::vector<topk_queue::entry_type> const& topk() const
+        {
+            return m_topk.topk();
+        }
+
+    private:
+        wand_data<scorer_type> const& m_wdata;
+        topk_queue m_topk;
+    };
+
+
+    struct block_max_wand_query {
+
+        typedef bm25 scorer_type;
+
+        block_max_wand_query(wand_data<scorer_type> const& wdata, uint64_t k)
+            : m_wdata(wdata)
+            , m_topk(k)
+        {}
+
+        template <typename Index>
+        uint64_t operator()(Index const& index, term_id_vec const& terms)
+        {
+            m_topk.clear();
+            if (terms.empty()) return 0;
+
+            auto query_term_freqs = query_freqs(terms);
+
+            uint64_t num_docs = index.num_docs();
+            typedef typename Index::document_enumerator enum_type;
+            typedef typename wand_data<scorer_type>::block_enumerator block_enum_type;
+            struct scored_enum {
+                enum_type docs_enum;
+                block_enum_type blocks;
+                float q_weight;
+                float max_weight;
+            };
+
+            std::vector<scored_enum> enums;
+            enums.reserve(query_term_freqs.size());
+
+            std::vector<enum_type> lists;
+            lists.reserve(query_term_freqs.size());
+            index.lookup_batch(query_term_freqs.begin(), query_term_freqs.end(),
+                               lists);
+
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                auto const& term = query_term_freqs[i];
+                auto& list = lists[i];
+                auto q_weight = scorer_type::query_term_weight
+                    (term.second, list.size(), num_docs);
+                auto max_weight = q_weight * m_wdata.max_term_weight(term.first);
+                enums.push_back(scored_enum {std::move(list),
+                                             m_wdata.block_max(term.first),
+                                             q_weight, max_weight});
+            }
+
+            std::vector<scored_enum*> ordered_enums;
+            ordered_enums.reserve(enums.size());
+            for (auto& en: enums) {
+                ordered_enums.push_back(&en);
+            }
+
+            auto sort_enums = [&]() {
+                // sort enumerators by increasing docid
+                std::sort(ordered_enums.begin(), ordered_enums.end(),
+                          [](scored_enum* lhs, scored_enum* rhs) {
+                              return lhs->docs_enum.docid() < rhs->docs_enum.docid();
+                          });
+            };
+
+            auto bubble_down = [&](size_t next_list) {
+                for (size_t i = next_list + 1; i < ordered_enums.size(); ++i) {
+                    if (ordered_enums[i]->docs_enum.docid() <
+                        ordered_enums[i - 1]->docs_enum.docid()) {
+                        std::swap(ordered_enums[i], ordered_enums[i - 1]);
+                    } else {
+                        break;
+                    }
+                }
+            };
+
+            sort_enums();
+            while (true) {
+                // find pivot, using the list-wide upper bounds
+                float upper_bound = 0;
+                size_t pivot;
+                bool found_pivot = false;
+                for (pivot = 0; pivot < ordered_enums.size(); ++pivot) {
+                    if (ordered_enums[pivot]->docs_enum.docid() == num_docs) {
+                        break;
+                    }
+                    upper_bound += ordered_enums[pivot]->max_weight;
+                    if (m_topk.would_enter(upper_bound)) {
+                        found_pivot = true;
+                        break;
+                    }
+                }
+
+                // no pivot found, we can stop the search
+                if (!found_pivot) {
+                    break;
+                }
+
+                // extend the pivot to all the lists positioned on the pivot
+                uint64_t pivot_id = ordered_enums[pivot]->docs_enum.docid();
+                while (pivot + 1 < ordered_enums.size() &&
+                       ordered_enums[pivot + 1]->docs_enum.docid() == pivot_id) {
+                    ++pivot;
+                }
+
+                // refine the upper bound with the maxima of the blocks
+                // containing the pivot
+                float block_upper_bound = 0;
+                for (size_t i = 0; i <= pivot; ++i) {
+                    scored_enum* en = ordered_enums[i];
+                    en->blocks.next_geq(pivot_id);
+                    block_upper_bound += en->q_weight * en->blocks.score();
+                }
+
+                if (m_topk.would_enter(block_upper_bound)) {
+                    if (pivot_id == ordered_enums[0]->docs_enum.docid()) {
+                        float score = 0;
+                        float norm_len = m_wdata.norm_len(pivot_id);
+                        for (scored_enum* en: ordered_enums) {
+                            if (en->docs_enum.docid() != pivot_id) {
+                                break;
+                            }
+                            float part_score = en->q_weight * scorer_type::doc_term_weight
+                                (en->docs_enum.freq(), norm_len);
+                            score += part_score;
+                            block_upper_bound -= en->q_weight * en->blocks.score() - part_score;
+                            if (!m_topk.would_enter(block_upper_bound)) {
+                                break;
+                            }
+                        }
+                        for (scored_enum* en: ordered_enums) {
+                            if (en->docs_enum.docid() != pivot_id) {
+                                break;
+                            }
+                            en->docs_enum.next();
+                        }
+
+                        m_topk.insert(score, pivot_id);
+                        // resort by docid
+                        sort_enums();
+                    } else {
+                        // no match, move farthest list up to the pivot
+                        uint64_t next_list = pivot;
+                        for (; ordered_enums[next_list]->docs_enum.docid() == pivot_id;
+                             --next_list);
+                        ordered_enums[next_list]->docs_enum.next_geq(pivot_id);
+                        bubble_down(next_list);
+                    }
+                } else {
+                    // no document can enter the heap before the end of the
+                    // shallowest block or the next list past the pivot:
+                    // skip there with the list of highest weight
+                    uint64_t next = num_docs;
+                    if (pivot + 1 < ordered_enums.size()) {
+                        next = ordered_enums[pivot + 1]->docs_enum.docid();
+                    }
+                    size_t next_list = 0;
+                    for (size_t i = 0; i <= pivot; ++i) {
+                        next = std::min(next, ordered_enums[i]->blocks.docid() + 1);
+                        if (ordered_enums[i]->q_weight >
+                            ordered_enums[next_list]->q_weight) {
+                            next_list = i;
+                        }
+                    }
+                    assert(next > pivot_id);
+
+                    ordered_enums[next_list]->docs_enum.next_geq(next);
+                    bubble_down(next_list);
+                }
+            }
+
+            m_topk.finalize();
+            return m_topk.topk().size();
+        }
+
+        std::vector<topk_queue::entry_type> const& topk() const
         {
             return m_topk.topk();
         }
@@ -346,8 +559,14 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
-            for (auto term: query_term_freqs) {
-                auto list = index[term.first];
+            std::vector<enum_type> lists;
+            lists.reserve(query_term_freqs.size());
+            index.lookup_batch(query_term_freqs.begin(), query_term_freqs.end(),
+                               lists);
+
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                auto const& term = query_term_freqs[i];
+                auto& list = lists[i];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
                 enums.push_back(scored_enum {std::move(list), q_weight});
@@ -379,7 +598,7 @@ namespace quasi_succinct {
                             (enums[i].docs_enum.freq(), norm_len);
                     }
 
-                    m_topk.insert(score);
+                    m_topk.insert(score, candidate);
                     enums[0].docs_enum.next();
                     candidate = enums[0].docs_enum.docid();
                     i = 1;
@@ -390,7 +609,7 @@ namespace quasi_succinct {
             return m_topk.topk().size();
         }
 
-        std::vector<float> const& topk() const
+        std::vector<topk_queue::entry_type> const& topk() const
         {
             return m_topk.topk();
         }
@@ -416,8 +635,26 @@ namespace quasi_succinct {
             m_topk.clear();
             if (terms.empty()) return 0;
 
-            auto query_term_freqs = query_freqs(terms);
+            process_range(m_wdata, index, query_freqs(terms),
+                          0, index.num_docs(), m_topk);
 
+            m_topk.finalize();
+            return m_topk.topk().size();
+        }
+
+        std::vector<topk_queue::entry_type> const& topk() const
+        {
+            return m_topk.topk();
+        }
+
+        // scores all the documents in [range_begin, range_end)
+        template <typename Index, typename TopK>
+        static void process_range(wand_data<scorer_type> const& wdata,
+                                  Index const& index,
+                                  term_freq_vec const& query_term_freqs,
+                                  uint64_t range_begin, uint64_t range_end,
+                                  TopK& topk)
+        {
             uint64_t num_docs = index.num_docs();
             typedef typename Index::document_enumerator enum_type;
             struct scored_enum {
@@ -428,10 +665,19 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
-            for (auto term: query_term_freqs) {
-                auto list = index[term.first];
+            std::vector<enum_type> lists;
+            lists.reserve(query_term_freqs.size());
+            index.lookup_batch(query_term_freqs.begin(), query_term_freqs.end(),
+                               lists);
+
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                auto const& term = query_term_freqs[i];
+                auto& list = lists[i];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
+                if (list.docid() < range_begin) {
+                    list.next_geq(range_begin);
+                }
                 enums.push_back(scored_enum {std::move(list), q_weight});
             }
 
@@ -442,10 +688,10 @@ namespace quasi_succinct {
                                  })
                 ->docs_enum.docid();
 
-            while (cur_doc < index.num_docs()) {
+            while (cur_doc < range_end) {
                 float score = 0;
-                float norm_len = m_wdata.norm_len(cur_doc);
-                uint64_t next_doc = index.num_docs();
+                float norm_len = wdata.norm_len(cur_doc);
+                uint64_t next_doc = num_docs;
                 for (size_t i = 0; i < enums.size(); ++i) {
                     if (enums[i].docs_enum.docid() == cur_doc) {
                         score += enums[i].q_weight * scorer_type::doc_term_weight
@@ -457,17 +703,9 @@ namespace quasi_succinct {
                     }
                 }
 
-                m_topk.insert(score);
+                topk.insert(score, cur_doc);
                 cur_doc = next_doc;
             }
-
-            m_topk.finalize();
-            return m_topk.topk().size();
-        }
-
-        std::vector<float> const& topk() const
-        {
-            return m_topk.topk();
         }
 
     private:
@@ -490,8 +728,27 @@ namespace quasi_succinct {
             m_topk.clear();
             if (terms.empty()) return 0;
 
-            auto query_term_freqs = query_freqs(terms);
+            process_range(m_wdata, index, query_freqs(terms),
+                          0, index.num_docs(), m_topk);
 
+            m_topk.finalize();
+            return m_topk.topk().size();
+        }
+
+        std::vector<topk_queue::entry_type> const& topk() const
+        {
+            return m_topk.topk();
+        }
+
+        // evaluates the query restricted to the documents in
+        // [range_begin, range_end)
+        template <typename Index, typename TopK>
+        static void process_range(wand_data<scorer_type> const& wdata,
+                                  Index const& index,
+                                  term_freq_vec const& query_term_freqs,
+                                  uint64_t range_begin, uint64_t range_end,
+                                  TopK& topk)
+        {
             uint64_t num_docs = index.num_docs();
             typedef typename Index::document_enumerator enum_type;
             struct scored_enum {
@@ -503,11 +760,20 @@ namespace quasi_succinct {
             std::vector<scored_enum> enums;
             enums.reserve(query_term_freqs.size());
 
-            for (auto term: query_term_freqs) {
-                auto list = index[term.first];
+            std::vector<enum_type> lists;
+            lists.reserve(query_term_freqs.size());
+            index.lookup_batch(query_term_freqs.begin(), query_term_freqs.end(),
+                               lists);
+
+            for (size_t i = 0; i < query_term_freqs.size(); ++i) {
+                auto const& term = query_term_freqs[i];
+                auto& list = lists[i];
                 auto q_weight = scorer_type::query_term_weight
                     (term.second, list.size(), num_docs);
-                auto max_weight = q_weight * m_wdata.max_term_weight(term.first);
+                auto max_weight = q_weight * wdata.max_term_weight(term.first);
+                if (list.docid() < range_begin) {
+                    list.next_geq(range_begin);
+                }
                 enums.push_back(scored_enum {std::move(list), q_weight, max_weight});
             }
 
@@ -538,10 +804,10 @@ namespace quasi_succinct {
                 ->docs_enum.docid();
 
             while (non_essential_lists < ordered_enums.size() &&
-                   cur_doc < index.num_docs()) {
+                   cur_doc < range_end) {
                 float score = 0;
-                float norm_len = m_wdata.norm_len(cur_doc);
-                uint64_t next_doc = index.num_docs();
+                float norm_len = wdata.norm_len(cur_doc);
+                uint64_t next_doc = num_docs;
                 for (size_t i = non_essential_lists; i < ordered_enums.size(); ++i) {
                     if (ordered_enums[i]->docs_enum.docid() == cur_doc) {
                         score += ordered_enums[i]->q_weight * scorer_type::doc_term_weight
@@ -555,7 +821,7 @@ namespace quasi_succinct {
 
                 // try to complete evaluation with non-essential lists
                 for (size_t i = non_essential_lists - 1; i + 1 > 0; --i) {
-                    if (!m_topk.would_enter(score + upper_bounds[i])) {
+                    if (!topk.would_enter(score + upper_bounds[i])) {
                         break;
                     }
                     ordered_enums[i]->docs_enum.next_geq(cur_doc);
@@ -565,30 +831,177 @@ namespace quasi_succinct {
                     }
                 }
 
-                if (m_topk.insert(score)) {
+                // the threshold of a shared queue can also be raised by
+                // other shards, so it must be checked even if the insertion
+                // fails
+                if (topk.insert(score, cur_doc) || TopK::is_shared) {
                     // update non-essential lists
                     while (non_essential_lists < ordered_enums.size() &&
-                           !m_topk.would_enter(upper_bounds[non_essential_lists])) {
+                           !topk.would_enter(upper_bounds[non_essential_lists])) {
                         non_essential_lists += 1;
                     }
                 }
 
                 cur_doc = next_doc;
             }
+        }
+
+    private:
+        wand_data<scorer_type> const& m_wdata;
+        topk_queue m_topk;
+    };
+
+    // A top-k queue local to a shard of a parallel query. The shards
+    // publish the lowest score in their full heaps to a common threshold,
+    // and every shard rejects the scores that do not exceed it: since the
+    // shards are disjoint, the global top-k cannot contain them.
+    struct shared_topk_queue {
+        static const bool is_shared = true;
+
+        shared_topk_queue(uint64_t k, std::atomic<float>& threshold)
+            : m_topk(k)
+            , m_threshold(threshold)
+        {}
+
+        bool insert(float score, uint64_t docid)
+        {
+            if (!would_enter(score) || !m_topk.insert(score, docid)) {
+                return false;
+            }
+
+            if (m_topk.full()) {
+                float cur = m_threshold.load(std::memory_order_relaxed);
+                float local = m_topk.threshold();
+                while (local > cur &&
+                       !m_threshold.compare_exchange_weak(cur, local,
+                                                          std::memory_order_relaxed));
+            }
+            return true;
+        }
+
+        bool would_enter(float score) const
+        {
+            return score > m_threshold.load(std::memory_order_relaxed)
+                && m_topk.would_enter(score);
+        }
+
+        topk_queue const& local() const
+        {
+            return m_topk;
+        }
+
+    private:
+        topk_queue m_topk;
+        std::atomic<float>& m_threshold;
+    };
+
+    // Runs QueryOperator::process_range over num_shards disjoint docid
+    // ranges, each in its own thread, and merges the results. Spawning the
+    // threads costs a few tens of microseconds, so this only pays off on
+    // queries with long lists.
+    template <typename QueryOperator>
+    struct parallel_ranked_query {
+
+        typedef typename QueryOperator::scorer_type scorer_type;
+
+        parallel_ranked_query(wand_data<scorer_type> const& wdata, uint64_t k,
+                              size_t num_shards)
+            : m_wdata(wdata)
+            , m_k(k)
+            , m_num_shards(num_shards)
+            , m_topk(k)
+        {
+            assert(num_shards > 0);
+        }
+
+        template <typename Index>
+        uint64_t operator()(Index const& index, term_id_vec const& terms)
+        {
+            m_topk.clear();
+            if (terms.empty()) return 0;
+
+            auto query_term_freqs = query_freqs(terms);
+            uint64_t num_docs = index.num_docs();
+            uint64_t shard_size = succinct::util::ceil_div(num_docs, m_num_shards);
+
+            std::atomic<float> threshold(std::numeric_limits<float>::lowest());
+            std::vector<shared_topk_queue> shard_topks;
+            shard_topks.reserve(m_num_shards);
+            for (size_t s = 0; s < m_num_shards; ++s) {
+                shard_topks.emplace_back(m_k, threshold);
+            }
+
+            auto run_shard = [&](size_t s) {
+                uint64_t range_begin = std::min(num_docs, s * shard_size);
+                uint64_t range_end = std::min(num_docs, range_begin + shard_size);
+                if (range_begin < range_end) {
+                    QueryOperator::process_range(m_wdata, index, query_term_freqs,
+                                                 range_begin, range_end,
+                                                 shard_topks[s]);
+                }
+            };
+
+            std::vector<std::thread> workers;
+            for (size_t s = 1; s < m_num_shards; ++s) {
+                workers.emplace_back(run_shard, s);
+            }
+            run_shard(0);
+            for (auto& w: workers) {
+                w.join();
+            }
+
+            for (auto const& shard_topk: shard_topks) {
+                for (auto const& entry: shard_topk.local().topk()) {
+                    m_topk.insert(entry.first, entry.second);
+                }
+            }
 
             m_topk.finalize();
             return m_topk.topk().size();
         }
 
-        std::vector<float> const& topk() const
+        std::vector<topk_queue::entry_type> const& topk() const
         {
             return m_topk.topk();
         }
 
     private:
         wand_data<scorer_type> const& m_wdata;
+        uint64_t m_k;
+        size_t m_num_shards;
         topk_queue m_topk;
     };
 
+    typedef parallel_ranked_query<ranked_or_query> parallel_ranked_or_query;
+    typedef parallel_ranked_query<maxscore_query> parallel_maxscore_query;
+
+    // Calls f(query_type, make_query_op, runs) for each query operator
+    // used by the benchmarks. make_query_op returns a new operator and
+    // runs is the default number of timed runs. The ranked operators need
+    // the wand data, and the parallel ones a positive number of shards.
+    template <typename Functor>
+    void for_each_query_type(wand_data<> const* wdata, size_t shards, Functor& f)
+    {
+        f("and", []() { return and_query<false>(); }, 3);
+        f("and_freq", []() { return and_query<true>(); }, 3);
+        f("or", []() { return or_query<false>(); }, 1);
+        f("or_freq", []() { return or_query<true>(); }, 1);
+
+        if (wdata) {
+            auto const& wd = *wdata;
+            f("ranked_and", [&]() { return ranked_and_query(wd, 10); }, 3);
+            f("ranked_or", [&]() { return ranked_or_query(wd, 10); }, 1);
+            f("wand", [&]() { return wand_query(wd, 10); }, 1);
+            f("block_max_wand", [&]() { return block_max_wand_query(wd, 10); }, 1);
+            f("maxscore", [&]() { return maxscore_query(wd, 10); }, 1);
+
+            if (shards) {
+                f("ranked_or_parallel",
+                  [&]() { return parallel_ranked_or_query(wd, 10, shards); }, 1);
+                f("maxscore_parallel",
+                  [&]() { return parallel_maxscore_query(wd, 10, shards); }, 1);
+            }
+        }
+    }
 
 }
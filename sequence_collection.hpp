@@ -4,7 +4,7 @@
 #include "compact_elias_fano.hpp"
 #include "integer_codes.hpp"
 #include "global_parameters.hpp"
-#include "semiasync_queue.hpp"
+#include "job_pool.hpp"
 
 namespace quasi_succinct {
 
@@ -45,7 +45,7 @@ namespace quasi_succinct {
         private:
 
             template <typename Iterator>
-            struct sequence_adder : semiasync_queue::job {
+            struct sequence_adder : job_pool::job {
                 sequence_adder(builder& b,
                                Iterator begin,
                                uint64_t last_element,
@@ -80,7 +80,7 @@ namespace quasi_succinct {
                 succinct::bit_vector_builder bits;
             };
 
-            semiasync_queue m_queue;
+            job_pool m_queue;
             global_parameters m_params;
             bitvector_collection::builder m_sequences;
         };
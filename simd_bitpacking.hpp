@@ -0,0 +1,160 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <boost/preprocessor/repetition/enum.hpp>
+
+#include "succinct/broadword.hpp"
+
+namespace quasi_succinct {
+
+    // The docids of a block are encoded as gaps minus one. prefix_sum
+    // turns the decoded gaps back into docids, four at a time in SSE
+    // registers, starting from the base of the block.
+    struct delta_decoding {
+        // inclusive prefix sum of the four lanes of v, plus carry
+        static __m128i prefix_sum(__m128i v, __m128i carry)
+        {
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+            return _mm_add_epi32(v, carry);
+        }
+
+        static __m128i last_lane(__m128i v)
+        {
+            return _mm_shuffle_epi32(v, 0xFF);
+        }
+
+        // buf[i] becomes base + (buf[0] + 1) + ... + (buf[i] + 1) - 1
+        static void prefix_sum(uint32_t* buf, size_t n, uint32_t base)
+        {
+            __m128i one = _mm_set1_epi32(1);
+            __m128i carry = _mm_set1_epi32(int(base - 1));
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i* p = reinterpret_cast<__m128i*>(buf + i);
+                __m128i v = prefix_sum(_mm_add_epi32(_mm_loadu_si128(p), one), carry);
+                _mm_storeu_si128(p, v);
+                carry = last_lane(v);
+            }
+            uint32_t last = uint32_t(_mm_cvtsi128_si32(carry));
+            for (; i < n; ++i) {
+                last += buf[i] + 1;
+                buf[i] = last;
+            }
+        }
+    };
+
+    // Bit packing of 128 integers in the vertical layout of SIMD-BP128:
+    // integer i is in lane i % 4 of an SSE register, so each instruction
+    // shifts and masks four integers, and b bits per integer take exactly
+    // b 16-byte words. The width is a template parameter, so that the
+    // shifts are constants once the loops are unrolled, and the functions
+    // are dispatched through tables indexed by width.
+    struct simd_bitpacking {
+        static const uint64_t block_size = 128;
+
+        // number of bits needed by the largest of the 128 values
+        static uint32_t bits(uint32_t const* in)
+        {
+            uint32_t acc = 0;
+            for (size_t i = 0; i < block_size; ++i) {
+                acc |= in[i];
+            }
+            return acc ? succinct::broadword::msb(acc) + 1 : 0;
+        }
+
+        static size_t packed_bytes(uint32_t b)
+        {
+            return 16 * b;
+        }
+
+        // the values are truncated to their low b bits
+        static void pack(uint32_t const* in, uint8_t* out, uint32_t b)
+        {
+            typedef void (*pack_fn)(uint32_t const*, uint8_t*);
+#define QS_PACK_FN(Z, B, _) &pack<B>
+            static const pack_fn table[] = { BOOST_PP_ENUM(33, QS_PACK_FN, _) };
+#undef QS_PACK_FN
+            table[b](in, out);
+        }
+
+        typedef void (*unpack_fn)(uint8_t const*, uint32_t*, uint32_t);
+
+        static void unpack(uint8_t const* in, uint32_t* out, uint32_t b)
+        {
+#define QS_UNPACK_FN(Z, B, _) &unpack<B, false>
+            static const unpack_fn table[] = { BOOST_PP_ENUM(33, QS_UNPACK_FN, _) };
+#undef QS_UNPACK_FN
+            table[b](in, out, 0);
+        }
+
+        // unpacks gaps and writes their prefix sums from base, as
+        // delta_decoding::prefix_sum, while they are still in registers
+        static void unpack_delta(uint8_t const* in, uint32_t* out,
+                                 uint32_t b, uint32_t base)
+        {
+#define QS_UNPACK_FN(Z, B, _) &unpack<B, true>
+            static const unpack_fn table[] = { BOOST_PP_ENUM(33, QS_UNPACK_FN, _) };
+#undef QS_UNPACK_FN
+            table[b](in, out, base);
+        }
+
+        template <uint32_t B>
+        static __m128i mask()
+        {
+            return _mm_set1_epi32(int(B == 32 ? uint32_t(-1) : (1U << (B % 32)) - 1));
+        }
+
+        template <uint32_t B>
+        static void pack(uint32_t const* in, uint8_t* out)
+        {
+            if (!B) return;
+            __m128i const* pin = reinterpret_cast<__m128i const*>(in);
+            __m128i* pout = reinterpret_cast<__m128i*>(out);
+            __m128i m = mask<B>();
+            __m128i acc = _mm_setzero_si128();
+            for (uint32_t j = 0; j < 32; ++j) {
+                uint32_t shift = (j * B) % 32;
+                __m128i v = _mm_and_si128(_mm_loadu_si128(pin + j), m);
+                acc = _mm_or_si128(acc, _mm_slli_epi32(v, shift));
+                if (shift + B >= 32) {
+                    _mm_storeu_si128(pout++, acc);
+                    // the high bits of v that did not fit
+                    acc = shift + B > 32
+                        ? _mm_srli_epi32(v, 32 - shift) : _mm_setzero_si128();
+                }
+            }
+        }
+
+        template <uint32_t B, bool Delta>
+        static void unpack(uint8_t const* in, uint32_t* out, uint32_t base)
+        {
+            __m128i const* pin = reinterpret_cast<__m128i const*>(in);
+            __m128i* pout = reinterpret_cast<__m128i*>(out);
+            __m128i m = mask<B>();
+            __m128i one = _mm_set1_epi32(1);
+            __m128i carry = _mm_set1_epi32(int(base - 1));
+            __m128i w = B ? _mm_loadu_si128(pin++) : _mm_setzero_si128();
+            for (uint32_t j = 0; j < 32; ++j) {
+                __m128i v = _mm_setzero_si128();
+                if (B) {
+                    uint32_t shift = (j * B) % 32;
+                    v = _mm_srli_epi32(w, shift);
+                    if (shift + B > 32) {
+                        w = _mm_loadu_si128(pin++);
+                        v = _mm_or_si128(v, _mm_slli_epi32(w, 32 - shift));
+                    } else if (shift + B == 32 && j != 31) {
+                        w = _mm_loadu_si128(pin++);
+                    }
+                    v = _mm_and_si128(v, m);
+                }
+                if (Delta) {
+                    v = delta_decoding::prefix_sum(_mm_add_epi32(v, one), carry);
+                    carry = delta_decoding::last_lane(v);
+                }
+                _mm_storeu_si128(pout + j, v);
+            }
+        }
+    };
+}
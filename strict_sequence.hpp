@@ -1,10 +1,13 @@
 #pragma once
 
 #include <stdexcept>
+#include <utility>
 
 #include "strict_elias_fano.hpp"
 #include "compact_ranked_bitvector.hpp"
 #include "all_ones_sequence.hpp"
+#include "configuration.hpp"
+#include "decode_cost.hpp"
 #include "global_parameters.hpp"
 
 namespace quasi_succinct {
@@ -29,23 +32,36 @@ namespace quasi_succinct {
             return params;
         }
 
-        static QS_FLATTEN_FUNC uint64_t
-        bitsize(global_parameters const& params, uint64_t universe, uint64_t n)
+        typedef std::pair<index_type, uint64_t> type_cost;
+
+        // as indexed_sequence::best_type
+        static QS_FLATTEN_FUNC type_cost
+        best_type(global_parameters const& params, uint64_t universe, uint64_t n,
+                  double lambda)
         {
-            uint64_t best_cost = all_ones_sequence::bitsize(params, universe, n);
+            if (all_ones_sequence::bitsize(params, universe, n) == 0) {
+                return type_cost(all_ones,
+                                 decode_cost::cost(decode_cost::all_ones, universe, n, lambda));
+            }
             auto sparams = strict_params(params);
 
-            uint64_t ef_cost = strict_elias_fano::bitsize(sparams, universe, n) + type_bits;
-            if (ef_cost < best_cost) {
-                best_cost = ef_cost;
-            }
+            type_cost best(elias_fano,
+                           strict_elias_fano::bitsize(sparams, universe, n) + type_bits
+                           + decode_cost::cost(decode_cost::elias_fano, universe, n, lambda));
 
-            uint64_t rb_cost = compact_ranked_bitvector::bitsize(sparams, universe, n) + type_bits;
-            if (rb_cost < best_cost) {
-                best_cost = rb_cost;
+            uint64_t rb_cost = compact_ranked_bitvector::bitsize(sparams, universe, n) + type_bits
+                + decode_cost::cost(decode_cost::ranked_bitvector, universe, n, lambda);
+            if (rb_cost < best.second) {
+                best = type_cost(ranked_bitvector, rb_cost);
             }
 
-            return best_cost;
+            return best;
+        }
+
+        static QS_FLATTEN_FUNC uint64_t
+        bitsize(global_parameters const& params, uint64_t universe, uint64_t n)
+        {
+            return best_type(params, universe, n, 0).second;
         }
 
         template <typename Iterator>
@@ -55,26 +71,13 @@ namespace quasi_succinct {
                           global_parameters const& params)
         {
             auto sparams = strict_params(params);
-            uint64_t best_cost = all_ones_sequence::bitsize(params, universe, n);
-            int best_type = all_ones;
-
-            if (best_cost) {
-                uint64_t ef_cost = strict_elias_fano::bitsize(sparams, universe, n) + type_bits;
-                if (ef_cost < best_cost) {
-                    best_cost = ef_cost;
-                    best_type = elias_fano;
-                }
-
-                uint64_t rb_cost = compact_ranked_bitvector::bitsize(sparams, universe, n) + type_bits;
-                if (rb_cost < best_cost) {
-                    best_cost = rb_cost;
-                    best_type = ranked_bitvector;
-                }
-
-                bvb.append_bits(best_type, type_bits);
+            index_type type = best_type(params, universe, n,
+                                        configuration::get().speed_lambda).first;
+            if (type != all_ones) {
+                bvb.append_bits(type, type_bits);
             }
 
-            switch (best_type) {
+            switch (type) {
             case elias_fano:
                 strict_elias_fano::write(bvb, begin,
                                          universe, n,
@@ -0,0 +1,59 @@
+#define BOOST_TEST_MODULE benchmark
+
+#include "test_generic_sequence.hpp"
+
+#include "benchmark.hpp"
+
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+BOOST_AUTO_TEST_CASE(histogram_quantiles)
+{
+    using namespace quasi_succinct;
+
+    // every bucket contains the values mapped to it
+    std::vector<uint64_t> edges = {0, 1, 127, 128, 129, 1000, 1ULL << 40,
+                                   (1ULL << 40) + 12345, uint64_t(-1)};
+    for (uint64_t v: edges) {
+        size_t b = latency_histogram::bucket(v);
+        MY_REQUIRE_EQUAL(true, b < latency_histogram::num_buckets, "v = " << v);
+        MY_REQUIRE_EQUAL(true, v <= latency_histogram::upper_bound(b), "v = " << v);
+        MY_REQUIRE_EQUAL(true, !b || v > latency_histogram::upper_bound(b - 1),
+                         "v = " << v);
+    }
+
+    // the quantiles are within the relative error of the exact ones
+    std::vector<uint64_t> values(100000);
+    latency_histogram h, h1, h2;
+    for (size_t i = 0; i < values.size(); ++i) {
+        // roughly log-uniform between 1us and 10ms
+        values[i] = uint64_t(1000 * std::pow(10000., double(rand()) / RAND_MAX));
+        h.record(values[i]);
+        (i % 2 ? h1 : h2).record(values[i]);
+    }
+    h1.merge(h2);
+    std::sort(values.begin(), values.end());
+
+    BOOST_REQUIRE_EQUAL(values.size(), h.count());
+    BOOST_REQUIRE_EQUAL(values.front(), h.min());
+    BOOST_REQUIRE_EQUAL(values.back(), h.max());
+    for (double q: {0.5, 0.9, 0.99, 0.999, 1.}) {
+        uint64_t exact = values[size_t(std::ceil(q * values.size())) - 1];
+        uint64_t approx = h.quantile(q);
+        MY_REQUIRE_EQUAL(true, approx >= exact, "q = " << q);
+        MY_REQUIRE_EQUAL(true, approx - exact <= exact / latency_histogram::half_bucket,
+                         "q = " << q);
+        MY_REQUIRE_EQUAL(approx, h1.quantile(q), "q = " << q);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tsc_calibration)
+{
+    using namespace quasi_succinct;
+
+    double ratio = tsc_clock::nsecs_per_tick();
+    BOOST_REQUIRE_GT(ratio, 0);
+    uint64_t tick = tsc_clock::now();
+    BOOST_REQUIRE_GE(tsc_clock::now(), tick);
+}
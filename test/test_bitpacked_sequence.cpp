@@ -0,0 +1,52 @@
+#define BOOST_TEST_MODULE bitpacked_sequence
+
+#include "test_generic_sequence.hpp"
+
+#include "bitpacked_sequence.hpp"
+#include <numeric>
+#include <vector>
+#include <cstdlib>
+
+BOOST_AUTO_TEST_CASE(bitpacked_sequence_singleton)
+{
+    quasi_succinct::global_parameters params;
+
+    std::vector<uint64_t> short_seq;
+    short_seq.push_back(0);
+    test_sequence(quasi_succinct::bitpacked_sequence(), params, 1, short_seq);
+    short_seq[0] = 1;
+    test_sequence(quasi_succinct::bitpacked_sequence(), params, 2, short_seq);
+}
+
+BOOST_AUTO_TEST_CASE(bitpacked_sequence_enumerator)
+{
+    quasi_succinct::global_parameters params;
+
+    // full and partial blocks, at widths from 0 (consecutive values) up
+    for (uint64_t n: {127, 128, 1000, 10000}) {
+        for (double avg_gap: {1., 1.1, 2.5, 10., 1000.}) {
+            uint64_t universe = uint64_t(n * avg_gap);
+            std::vector<uint64_t> seq(n);
+            if (universe > n) {
+                seq = random_sequence(universe, n, true);
+            } else {
+                std::iota(seq.begin(), seq.end(), 0);
+            }
+
+            succinct::bit_vector_builder bvb;
+            quasi_succinct::bitpacked_sequence::write(bvb, seq.begin(),
+                                                      universe, seq.size(),
+                                                      params);
+            uint64_t max_gap = quasi_succinct::bitpacked_sequence::max_gap(seq.begin(), n);
+            BOOST_REQUIRE_EQUAL(quasi_succinct::bitpacked_sequence::bitsize(
+                                    params, universe, n, max_gap),
+                                bvb.size());
+
+            succinct::bit_vector bv(&bvb);
+            quasi_succinct::bitpacked_sequence::enumerator r(bv, 0, universe,
+                                                             seq.size(), params);
+            test_sequence(r, seq);
+            test_decode_range(r, seq);
+        }
+    }
+}
@@ -29,6 +29,18 @@ void test_block_codec()
             BOOST_REQUIRE_EQUAL(encoded.size(), out - encoded.data());
             BOOST_REQUIRE_EQUAL_COLLECTIONS(values.begin(), values.end(),
                                             decoded.begin(), decoded.end());
+
+            // the values as gaps minus one, decoded into docids
+            uint32_t base = 12345;
+            std::vector<uint32_t> docs(values.size());
+            out = quasi_succinct::block_decode_docs<BlockCodec>
+                (encoded.data(), docs.data(), sum_of_values, values.size(), base);
+            BOOST_REQUIRE_EQUAL(encoded.size(), out - encoded.data());
+            uint32_t doc = base - 1;
+            for (size_t i = 0; i < values.size(); ++i) {
+                doc += values[i] + 1;
+                MY_REQUIRE_EQUAL(doc, docs[i], "i = " << i << " size = " << size);
+            }
         }
     }
 }
@@ -41,4 +53,38 @@ BOOST_AUTO_TEST_CASE(block_codecs)
     test_block_codec<quasi_succinct::u32_block>();
     test_block_codec<quasi_succinct::vbyte_block>();
     test_block_codec<quasi_succinct::simple16_block>();
+    test_block_codec<quasi_succinct::simdbp128_block>();
+    test_block_codec<quasi_succinct::simd_pfor_block>();
+}
+
+// full blocks of every bit width, with a few outliers that become
+// exceptions in simd_pfor
+template <typename BlockCodec>
+void test_bit_widths()
+{
+    for (uint32_t b = 0; b <= 32; ++b) {
+        for (size_t outliers = 0; outliers <= 8; outliers += 4) {
+            std::vector<uint32_t> values(BlockCodec::block_size);
+            for (auto& v: values) {
+                v = b ? uint32_t(rand()) & (uint32_t(-1) >> (32 - b)) : 0;
+            }
+            for (size_t i = 0; i < outliers; ++i) {
+                values[rand() % values.size()] = uint32_t(rand()) << 1 | 1;
+            }
+            std::vector<uint8_t> encoded;
+            BlockCodec::encode(values.data(), uint32_t(-1), values.size(), encoded);
+            std::vector<uint32_t> decoded(values.size());
+            uint8_t const* out = BlockCodec::decode(encoded.data(), decoded.data(),
+                                                    uint32_t(-1), values.size());
+            BOOST_REQUIRE_EQUAL(encoded.size(), out - encoded.data());
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(values.begin(), values.end(),
+                                            decoded.begin(), decoded.end());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simd_block_codecs)
+{
+    test_bit_widths<quasi_succinct::simdbp128_block>();
+    test_bit_widths<quasi_succinct::simd_pfor_block>();
 }
@@ -39,6 +39,18 @@ void test_block_freq_index()
         succinct::mapper::freeze(coll, "temp.bin");
     }
 
+    {
+        // a tiny memory budget, so that the lists are spilled many times
+        typename collection_type::stream_builder sb(universe, params,
+                                                    "temp_stream.bin", 1024);
+        for (auto const& plist: posting_lists) {
+            sb.add_posting_list(plist.first.size(), plist.first.begin(),
+                                plist.second.begin(), 0);
+        }
+        sb.build();
+    }
+    BOOST_REQUIRE(read_file("temp.bin") == read_file("temp_stream.bin"));
+
     {
         collection_type coll;
         boost::iostreams::mapped_file_source m("temp.bin");
@@ -56,6 +68,8 @@ void test_block_freq_index()
             }
             BOOST_REQUIRE_EQUAL(coll.num_docs(), doc_enum.docid());
         }
+
+        test_lookup_batch(coll, posting_lists);
     }
 }
 
@@ -66,4 +80,6 @@ BOOST_AUTO_TEST_CASE(block_freq_index)
     test_block_freq_index<quasi_succinct::interpolative_block>();
     test_block_freq_index<quasi_succinct::u32_block>();
     test_block_freq_index<quasi_succinct::vbyte_block>();
+    test_block_freq_index<quasi_succinct::simdbp128_block>();
+    test_block_freq_index<quasi_succinct::simd_pfor_block>();
 }
@@ -8,6 +8,7 @@
 #include <vector>
 #include <cstdlib>
 #include <algorithm>
+#include <limits>
 
 template <typename BlockCodec>
 void test_block_posting_list()
@@ -33,6 +34,19 @@ void test_block_posting_list()
             MY_REQUIRE_EQUAL(freqs[i], e.freq(),
                              "i = " << i << " size = " << n);
         }
+        // copies carry their own decoded block
+        e.reset();
+        e.move(n / 2);
+        auto e_copy = e;
+        e.reset();
+        for (size_t i = n / 2; i < n; ++i, e_copy.next()) {
+            MY_REQUIRE_EQUAL(docs[i], e_copy.docid(),
+                             "i = " << i << " size = " << n);
+            MY_REQUIRE_EQUAL(freqs[i], e_copy.freq(),
+                             "i = " << i << " size = " << n);
+        }
+        BOOST_REQUIRE_EQUAL(docs[0], e.docid());
+
         // XXX better testing of next_geq
         for (size_t i = 0; i < n; ++i) {
             e.reset();
@@ -46,6 +60,92 @@ void test_block_posting_list()
         BOOST_REQUIRE_EQUAL(universe, e.docid());
         e.reset(); e.next_geq(universe);
         BOOST_REQUIRE_EQUAL(universe, e.docid());
+
+        // skips of increasing length, with only galloping, only linear
+        // scan and the default
+        for (uint32_t scan: {uint32_t(0), uint32_t(2),
+                    std::numeric_limits<uint32_t>::max()}) {
+            e.set_linear_scan_blocks(scan);
+            for (size_t skip = 1; skip < n; skip *= 3) {
+                e.reset();
+                for (size_t i = skip; i < n; i += skip) {
+                    uint64_t lower_bound = docs[i - 1] + 1 + rand() % (docs[i] - docs[i - 1]);
+                    e.next_geq(lower_bound);
+                    MY_REQUIRE_EQUAL(docs[i], e.docid(),
+                                     "i = " << i << " skip = " << skip
+                                     << " scan = " << scan);
+                    MY_REQUIRE_EQUAL(i, e.position(),
+                                     "i = " << i << " skip = " << skip
+                                     << " scan = " << scan);
+                }
+            }
+        }
+    }
+}
+
+// Compares linear scan and galloping search of the block maxima in
+// next_geq for skips of increasing length, to find the crossover point
+// to use as QS_BLOCK_LINEAR_SCAN
+template <typename BlockCodec>
+void benchmark_next_geq(std::string const& codec)
+{
+    using namespace quasi_succinct;
+    typedef block_posting_list<BlockCodec> posting_list_type;
+    static const uint64_t block_size = BlockCodec::block_size;
+
+    uint64_t n = 1 << 18;
+    uint64_t universe = 4 * n;
+    std::vector<uint64_t> docs = random_sequence(universe, n, true);
+    std::vector<uint64_t> freqs(n, 1);
+    std::vector<uint8_t> data;
+    posting_list_type::write(data, n, docs.begin(), freqs.begin());
+
+    // smallest skip from which galloping is always faster
+    uint64_t crossover = 0;
+    for (uint64_t skip_blocks = 1; skip_blocks < n / block_size; skip_blocks *= 2) {
+        uint64_t skip = skip_blocks * block_size;
+        double times[2];
+        uint64_t checksums[2];
+        for (size_t galloping = 0; galloping < 2; ++galloping) {
+            typename posting_list_type::document_enumerator e(data.data(), universe);
+            e.set_linear_scan_blocks(galloping
+                                     ? 0 : std::numeric_limits<uint32_t>::max());
+            times[galloping] = std::numeric_limits<double>::max();
+            for (size_t run = 0; run < 3; ++run) { // keep the best run
+                uint64_t calls = 0;
+                checksums[galloping] = 0;
+                double tick = get_time_usecs();
+                while (calls < 20000) {
+                    e.reset();
+                    for (size_t i = skip - 1; i < n; i += skip, ++calls) {
+                        e.next_geq(docs[i]);
+                        checksums[galloping] += e.docid();
+                    }
+                }
+                times[galloping] = std::min(times[galloping],
+                                            (get_time_usecs() - tick) * 1000 / calls);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(checksums[0], checksums[1]);
+
+        if (times[1] >= times[0]) {
+            crossover = 0;
+        } else if (!crossover) {
+            crossover = skip_blocks;
+        }
+        stats_line()
+            ("codec", codec)
+            ("skip_blocks", skip_blocks)
+            ("linear_ns", times[0])
+            ("galloping_ns", times[1])
+            ;
+    }
+    if (crossover) {
+        logger() << codec << ": galloping is faster from skips of "
+                 << crossover << " blocks" << std::endl;
+    } else {
+        logger() << codec << ": linear scan is faster up to skips of "
+                 << n / block_size / 2 << " blocks" << std::endl;
     }
 }
 
@@ -54,4 +154,18 @@ BOOST_AUTO_TEST_CASE(block_posting_list)
     test_block_posting_list<quasi_succinct::optpfor_block>();
     test_block_posting_list<quasi_succinct::varint_G8IU_block>();
     test_block_posting_list<quasi_succinct::interpolative_block>();
+    test_block_posting_list<quasi_succinct::simdbp128_block>();
+    test_block_posting_list<quasi_succinct::simd_pfor_block>();
+}
+
+BOOST_AUTO_TEST_CASE(block_posting_list_next_geq_benchmark)
+{
+    benchmark_next_geq<quasi_succinct::optpfor_block>("optpfor");
+    benchmark_next_geq<quasi_succinct::varint_G8IU_block>("varint_G8IU");
+    benchmark_next_geq<quasi_succinct::interpolative_block>("interpolative");
+    benchmark_next_geq<quasi_succinct::u32_block>("u32");
+    benchmark_next_geq<quasi_succinct::vbyte_block>("vbyte");
+    benchmark_next_geq<quasi_succinct::simple16_block>("simple16");
+    benchmark_next_geq<quasi_succinct::simdbp128_block>("simdbp128");
+    benchmark_next_geq<quasi_succinct::simd_pfor_block>("simd_pfor");
 }
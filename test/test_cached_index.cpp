@@ -0,0 +1,108 @@
+#define BOOST_TEST_MODULE cached_index
+
+#include "test_generic_sequence.hpp"
+
+#include "cached_index.hpp"
+#include "freq_index.hpp"
+#include "partitioned_sequence.hpp"
+#include "positive_sequence.hpp"
+
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+#include <numeric>
+
+BOOST_AUTO_TEST_CASE(term_cache)
+{
+    using namespace quasi_succinct;
+    typedef freq_index<partitioned_sequence<>,
+                       positive_sequence<partitioned_sequence<strict_sequence>>>
+        collection_type;
+
+    global_parameters params;
+    uint64_t universe = 20000;
+    collection_type::builder b(universe, params);
+
+    typedef std::vector<uint64_t> vec_type;
+    std::vector<std::pair<vec_type, vec_type>> posting_lists(200);
+    for (auto& plist: posting_lists) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 100;
+        uint64_t n = uint64_t(universe / avg_gap);
+        plist.first = random_sequence(universe, n, true);
+        plist.second.resize(n);
+        std::generate(plist.second.begin(), plist.second.end(),
+                      []() { return (rand() % 256) + 1; });
+        uint64_t freqs_sum = std::accumulate(plist.second.begin(),
+                                             plist.second.end(), uint64_t(0));
+        b.add_posting_list(n, plist.first.begin(),
+                           plist.second.begin(), freqs_sum);
+    }
+
+    collection_type coll;
+    b.build(coll);
+
+    auto check_list = [&](collection_type::document_enumerator e, size_t term) {
+        auto const& plist = posting_lists[term];
+        MY_REQUIRE_EQUAL(plist.first.size(), e.size(), "term = " << term);
+        for (size_t p = 0; p < plist.first.size(); p += 1 + p / 4) {
+            e.move(p);
+            MY_REQUIRE_EQUAL(plist.first[p], e.docid(),
+                             "term = " << term << " p = " << p);
+            MY_REQUIRE_EQUAL(plist.second[p], e.freq(),
+                             "term = " << term << " p = " << p);
+        }
+    };
+
+    {
+        // a cache large enough for every term: after the first round
+        // everything is a hit
+        cached_index<collection_type> cached(coll, posting_lists.size() * 2);
+        BOOST_REQUIRE_EQUAL(coll.size(), cached.size());
+        BOOST_REQUIRE_EQUAL(coll.num_docs(), cached.num_docs());
+        for (size_t round = 0; round < 3; ++round) {
+            for (size_t term = 0; term < posting_lists.size(); ++term) {
+                check_list(cached[term], term);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(posting_lists.size(), cached.misses());
+        BOOST_REQUIRE_EQUAL(2 * posting_lists.size(), cached.hits());
+    }
+
+    {
+        // a small cache shared by several threads, with a skewed access
+        // pattern, so that entries are evicted while they are being read
+        cached_index<collection_type> cached(coll, 16);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> errors(0);
+        size_t lookups = 20000;
+        for (size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t]() {
+                    uint64_t state = t + 1;
+                    for (size_t i = 0; i < lookups; ++i) {
+                        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                        uint64_t r = state >> 33;
+                        size_t term = (r % 4) ? r % 8 : r % posting_lists.size();
+                        auto e = cached[term];
+                        auto const& plist = posting_lists[term];
+                        if (e.size() != plist.first.size() ||
+                            e.docid() != plist.first[0] ||
+                            e.freq() != plist.second[0]) {
+                            ++errors;
+                        }
+                    }
+                });
+        }
+        for (auto& t: threads) t.join();
+        BOOST_REQUIRE_EQUAL(0U, errors.load());
+        BOOST_REQUIRE_EQUAL(4 * lookups, cached.hits() + cached.misses());
+        BOOST_REQUIRE_GT(cached.hits(), cached.misses());
+    }
+
+    {
+        // capacity 0 disables the cache
+        cached_index<collection_type> cached(coll, 0);
+        check_list(cached[3], 3);
+        BOOST_REQUIRE_EQUAL(0U, cached.hits());
+    }
+}
@@ -86,6 +86,7 @@ BOOST_FIXTURE_TEST_CASE(compact_elias_fano_enumerator,
                                                      universe, seq.size(),
                                                      params);
     test_sequence(r, seq);
+    test_decode_range(r, seq);
 }
 
 BOOST_FIXTURE_TEST_CASE(compact_elias_fano_weakly_monotone,
@@ -85,4 +85,5 @@ BOOST_FIXTURE_TEST_CASE(compact_ranked_bitvector_enumerator,
                                                            universe, seq.size(),
                                                            params);
     test_sequence(r, seq);
+    test_decode_range(r, seq);
 }
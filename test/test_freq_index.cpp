@@ -46,6 +46,20 @@ void test_freq_index()
         succinct::mapper::freeze(coll, "temp.bin");
     }
 
+    {
+        // a tiny memory budget, so that the lists are spilled many times
+        typename collection_type::stream_builder sb(universe, params,
+                                                    "temp_stream.bin", 1024);
+        for (auto const& plist: posting_lists) {
+            uint64_t freqs_sum = std::accumulate(plist.second.begin(),
+                                                 plist.second.end(), uint64_t(0));
+            sb.add_posting_list(plist.first.size(), plist.first.begin(),
+                                plist.second.begin(), freqs_sum);
+        }
+        sb.build();
+    }
+    BOOST_REQUIRE(read_file("temp.bin") == read_file("temp_stream.bin"));
+
     {
         collection_type coll;
         boost::iostreams::mapped_file_source m("temp.bin");
@@ -62,7 +76,27 @@ void test_freq_index()
                                  "i = " << i << " p = " << p);
             }
             BOOST_REQUIRE_EQUAL(coll.num_docs(), doc_enum.docid());
+
+            std::vector<uint32_t> buf(plist.first.size());
+            doc_enum.reset();
+            doc_enum.next();
+            uint64_t batch_size = 1 + rand() % 200;
+            uint64_t p = 1;
+            while (uint64_t n = doc_enum.next_batch(buf.data(), batch_size)) {
+                for (uint64_t j = 0; j < n; ++j, ++p) {
+                    MY_REQUIRE_EQUAL(plist.first[p], buf[j],
+                                     "i = " << i << " p = " << p);
+                }
+                if (p < plist.first.size()) {
+                    MY_REQUIRE_EQUAL(plist.first[p], doc_enum.docid(),
+                                     "i = " << i << " p = " << p);
+                }
+            }
+            BOOST_REQUIRE_EQUAL(plist.first.size(), p);
+            BOOST_REQUIRE_EQUAL(coll.num_docs(), doc_enum.docid());
         }
+
+        test_lookup_batch(coll, posting_lists);
     }
 }
 
@@ -4,6 +4,10 @@
 #include "succinct/bit_vector.hpp"
 #include "util.hpp"
 
+#include <fstream>
+#include <iterator>
+#include <string>
+
 std::vector<uint64_t> random_sequence(size_t universe, size_t n,
                                       bool strict = true)
 {
@@ -25,6 +29,54 @@ std::vector<uint64_t> random_sequence(size_t universe, size_t n,
     return seq;
 }
 
+inline std::string read_file(const char* filename)
+{
+    std::ifstream is(filename, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(is),
+                       std::istreambuf_iterator<char>());
+}
+
+// checks that lookup_batch returns the same lists as operator[], on
+// batches which are unsorted, have duplicates, and span several internal
+// batches
+template <typename Collection, typename PostingLists>
+void test_lookup_batch(Collection const& coll, PostingLists const& posting_lists)
+{
+    std::vector<uint64_t> terms;
+    for (size_t i = 0; i < 3 * quasi_succinct::max_lookup_batch; ++i) {
+        terms.push_back(rand() % coll.size());
+    }
+    terms.push_back(terms.front());
+
+    // prefetch is only a hint, but it must accept the same batches
+    coll.prefetch(terms.begin(), terms.end());
+
+    std::vector<typename Collection::document_enumerator> enums;
+    coll.lookup_batch(terms.begin(), terms.end(), enums);
+    BOOST_REQUIRE_EQUAL(terms.size(), enums.size());
+    for (size_t i = 0; i < terms.size(); ++i) {
+        auto const& plist = posting_lists[terms[i]];
+        auto& e = enums[i];
+        MY_REQUIRE_EQUAL(plist.first.size(), e.size(), "i = " << i);
+        for (size_t p = 0; p < plist.first.size(); p += 1 + p / 2) {
+            e.next_geq(plist.first[p]);
+            MY_REQUIRE_EQUAL(plist.first[p], e.docid(), "i = " << i << " p = " << p);
+            MY_REQUIRE_EQUAL(plist.second[p], e.freq(), "i = " << i << " p = " << p);
+        }
+    }
+
+    // sorted input, as passed by the query operators
+    std::sort(terms.begin(), terms.end());
+    enums.clear();
+    coll.lookup_batch(terms.begin(), terms.end(), enums);
+    for (size_t i = 0; i < terms.size(); ++i) {
+        MY_REQUIRE_EQUAL(posting_lists[terms[i]].first.size(), enums[i].size(),
+                         "i = " << i);
+        MY_REQUIRE_EQUAL(posting_lists[terms[i]].first[0], enums[i].docid(),
+                         "i = " << i);
+    }
+}
+
 template <typename SequenceReader>
 void test_move_next(SequenceReader r, std::vector<uint64_t> const& seq)
 {
@@ -163,6 +215,54 @@ void test_next_geq(SequenceReader r, std::vector<uint64_t> const& seq)
     }
 }
 
+template <typename SequenceReader>
+void check_decode_range(SequenceReader r, std::vector<uint64_t> const& seq,
+                        uint64_t position, uint64_t count,
+                        std::vector<uint32_t>& buf)
+{
+    r.decode_range(position, count, buf.data());
+    for (uint64_t i = 0; i < count; ++i) {
+        MY_REQUIRE_EQUAL(seq[position + i], buf[i],
+                         "position = " << position << " count = " << count
+                         << " i = " << i);
+    }
+
+    // the enumerator must be left on the last decoded value
+    auto val = r.next();
+    MY_REQUIRE_EQUAL(position + count, val.first,
+                     "position = " << position << " count = " << count);
+    if (position + count < seq.size()) {
+        MY_REQUIRE_EQUAL(seq[position + count], val.second,
+                         "position = " << position << " count = " << count);
+    }
+    MY_REQUIRE_EQUAL(seq[position + count - 1], r.prev_value(),
+                     "position = " << position << " count = " << count);
+}
+
+template <typename SequenceReader>
+void test_decode_range(SequenceReader r, std::vector<uint64_t> const& seq)
+{
+    BOOST_REQUIRE_EQUAL(seq.size(), r.size());
+    if (seq.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> buf(seq.size());
+    check_decode_range(r, seq, 0, seq.size(), buf);
+
+    for (size_t i = 0; i < seq.size(); i = 2 * i + 1) {
+        for (size_t count = 1; count <= seq.size() - i; count <<= 1) {
+            check_decode_range(r, seq, i, count, buf);
+        }
+    }
+
+    for (size_t t = 0; t < 100; ++t) {
+        uint64_t position = rand() % seq.size();
+        uint64_t count = 1 + rand() % std::min<uint64_t>(seq.size() - position, 1000);
+        check_decode_range(r, seq, position, count, buf);
+    }
+}
+
 // oh, C++
 struct no_next_geq_tag {};
 struct next_geq_tag : no_next_geq_tag {};
@@ -202,3 +302,16 @@ inline void test_sequence(SequenceType,
     test_sequence(r, seq);
 }
 
+template <typename ParamsType, typename SequenceType>
+inline void test_decode_range(SequenceType,
+                              ParamsType const& params,
+                              uint64_t universe,
+                              std::vector<uint64_t> const& seq)
+{
+    succinct::bit_vector_builder bvb;
+    SequenceType::write(bvb, seq.begin(), universe, seq.size(), params);
+    succinct::bit_vector bv(&bvb);
+    typename SequenceType::enumerator r(bv, 0, universe, seq.size(), params);
+    test_decode_range(r, seq);
+}
+
@@ -0,0 +1,88 @@
+#define BOOST_TEST_MODULE index_memory
+
+#include "test_generic_sequence.hpp"
+
+#include "index_memory.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_CASE(numa_parse_list)
+{
+    using quasi_succinct::numa::parse_list;
+    BOOST_REQUIRE(parse_list("") == std::vector<size_t>());
+    BOOST_REQUIRE(parse_list("0") == std::vector<size_t>({0}));
+    BOOST_REQUIRE(parse_list("0-3,8,10-11") ==
+                  std::vector<size_t>({0, 1, 2, 3, 8, 10, 11}));
+    BOOST_REQUIRE(!quasi_succinct::numa::nodes().empty());
+}
+
+BOOST_AUTO_TEST_CASE(index_memory)
+{
+    using quasi_succinct::index_memory;
+
+    // not a multiple of any page size
+    std::string contents;
+    for (size_t i = 0; i < 3 * 4096 + 17; ++i) {
+        contents.push_back(char(rand()));
+    }
+    {
+        std::ofstream os("temp.bin", std::ios::binary);
+        os.write(contents.data(), contents.size());
+    }
+
+    for (std::string mode: {"mmap", "copy", "huge"}) {
+        for (size_t threads: {1, 3}) {
+            index_memory m("temp.bin", mode, index_memory::placement::none,
+                           0, threads);
+            BOOST_REQUIRE_EQUAL(mode, m.page_mode());
+            BOOST_REQUIRE_EQUAL(contents.size(), m.size());
+            BOOST_REQUIRE(std::string(m.data(), m.size()) == contents);
+        }
+    }
+
+    {
+        // placement is advisory on machines with a single node
+        index_memory m("temp.bin", "copy",
+                       index_memory::placement::interleave);
+        BOOST_REQUIRE(std::string(m.data(), m.size()) == contents);
+    }
+
+    BOOST_CHECK_THROW(index_memory("temp.bin", "mmap",
+                                   index_memory::placement::bind),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(index_memory("temp.bin", "nonexistent"),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(for_each_chunk)
+{
+    size_t const mb = 1 << 20;
+    for (size_t size: {size_t(0), size_t(1), 3 * mb, 17 * mb + 5}) {
+        for (size_t threads: {1, 2, 3, 8}) {
+            std::vector<std::pair<size_t, size_t>> chunks;
+            std::mutex m;
+            quasi_succinct::for_each_chunk(size, threads, [&](size_t begin, size_t end) {
+                    std::lock_guard<std::mutex> lock(m);
+                    chunks.emplace_back(begin, end);
+                });
+            std::sort(chunks.begin(), chunks.end());
+            BOOST_REQUIRE_LE(chunks.size(), threads);
+            size_t covered = 0;
+            for (auto const& c: chunks) {
+                BOOST_REQUIRE_EQUAL(covered, c.first);
+                covered = c.second;
+            }
+            BOOST_REQUIRE_EQUAL(size, covered);
+        }
+    }
+
+    // the prefaulting helpers only read the memory
+    std::vector<char> data(5 * mb, 1);
+    quasi_succinct::parallel_warmup(data.data(), data.size(), 3);
+    std::vector<quasi_succinct::byte_range> ranges = {{4 * mb, mb}, {0, 10}, {mb + 1, 2 * mb}};
+    quasi_succinct::prefault_ranges(data.data(), data.size(), ranges, 2);
+}
@@ -17,5 +17,68 @@ BOOST_AUTO_TEST_CASE(indexed_sequence)
         auto seq = random_sequence(universe, n, true);
 
         test_sequence(quasi_succinct::indexed_sequence(), params, universe, seq);
+        test_decode_range(quasi_succinct::indexed_sequence(), params, universe, seq);
     }
 }
+
+BOOST_AUTO_TEST_CASE(indexed_sequence_decode_cost)
+{
+    quasi_succinct::global_parameters params;
+    typedef quasi_succinct::indexed_sequence sequence_type;
+    typedef quasi_succinct::decode_cost decode_cost;
+
+    // without lambda the cost is the size
+    for (uint64_t universe: {1000, 1500, 3000, 100000}) {
+        auto best = sequence_type::best_type(params, universe, 1000, 0);
+        BOOST_REQUIRE_EQUAL(sequence_type::bitsize(params, universe, 1000), best.second);
+    }
+
+    // at an average gap of 4 Elias-Fano is smaller, but the ranked
+    // bitvector is faster to decode
+    uint64_t universe = 4000, n = 1000;
+    BOOST_REQUIRE_EQUAL(sequence_type::elias_fano,
+                        sequence_type::best_type(params, universe, n, 0).first);
+    BOOST_REQUIRE_LT(decode_cost::ns_per_element(decode_cost::ranked_bitvector, universe, n),
+                     decode_cost::ns_per_element(decode_cost::elias_fano, universe, n));
+    auto fast = sequence_type::best_type(params, universe, n, 10);
+    BOOST_REQUIRE_EQUAL(sequence_type::ranked_bitvector, fast.first);
+    BOOST_REQUIRE_EQUAL(quasi_succinct::compact_ranked_bitvector::bitsize(params, universe, n)
+                        + sequence_type::type_bits
+                        + decode_cost::cost(decode_cost::ranked_bitvector, universe, n, 10),
+                        fast.second);
+}
+
+BOOST_AUTO_TEST_CASE(bitpacked_indexed_sequence)
+{
+    quasi_succinct::global_parameters params;
+    typedef quasi_succinct::bitpacked_indexed_sequence sequence_type;
+
+    std::vector<double> avg_gaps = { 1.1, 1.9, 2.5, 3, 4, 5, 10 };
+    for (auto avg_gap: avg_gaps) {
+        uint64_t n = 10000;
+        uint64_t universe = uint64_t(n * avg_gap);
+        auto seq = random_sequence(universe, n, true);
+
+        test_sequence(sequence_type(), params, universe, seq);
+        test_decode_range(sequence_type(), params, universe, seq);
+    }
+
+    // gaps of 1 to 4: smaller bit packed than in Elias-Fano or in a
+    // ranked bitvector
+    std::vector<uint64_t> seq;
+    uint64_t value = 0;
+    for (size_t i = 0; i < 10000; ++i) {
+        seq.push_back(value);
+        value += 1 + rand() % 4;
+    }
+    uint64_t universe = value;
+    uint64_t max_gap = quasi_succinct::bitpacked_sequence::max_gap(seq.begin(), seq.size());
+    uint64_t bp_cost = quasi_succinct::bitpacked_sequence::bitsize(params, universe,
+                                                                   seq.size(), max_gap);
+    BOOST_REQUIRE_EQUAL(bp_cost + sequence_type::type_bits,
+                        sequence_type::bitsize(params, universe, seq.size(), max_gap));
+    BOOST_REQUIRE_LT(bp_cost, quasi_succinct::indexed_sequence::bitsize(params, universe,
+                                                                        seq.size()));
+    test_sequence(sequence_type(), params, universe, seq);
+    test_decode_range(sequence_type(), params, universe, seq);
+}
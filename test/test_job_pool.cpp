@@ -0,0 +1,60 @@
+#define BOOST_TEST_MODULE job_pool
+
+#include "succinct/test_common.hpp"
+
+#include "job_pool.hpp"
+
+#include <vector>
+#include <cstdlib>
+
+namespace {
+    struct test_job : quasi_succinct::job_pool::job {
+        test_job(std::vector<size_t>& committed, size_t i)
+            : committed(committed)
+            , i(i)
+            , result(0)
+        {}
+
+        virtual void prepare()
+        {
+            // uneven amounts of work, so that the jobs complete out of order
+            size_t work = (i % 7 == 0) ? 100000 : (i % 5) * 1000;
+            for (size_t k = 0; k < work; ++k) {
+                result += k ^ i;
+            }
+        }
+
+        virtual void commit()
+        {
+            committed.push_back(i);
+        }
+
+        std::vector<size_t>& committed;
+        size_t i;
+        uint64_t result;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(job_pool)
+{
+    // use several workers even on small machines; must be set before the
+    // configuration is first read
+    setenv("QS_THREADS", "4", 0);
+
+    std::vector<size_t> committed;
+    size_t n = 20000;
+    {
+        // small work budget, so that add_job also has to wait
+        quasi_succinct::job_pool pool(1000);
+        for (size_t i = 0; i < n; ++i) {
+            pool.add_job(std::make_shared<test_job>(committed, i), 1 + i % 13);
+        }
+        pool.complete();
+        BOOST_REQUIRE_LE(pool.utilization(), 1.0);
+    }
+
+    BOOST_REQUIRE_EQUAL(n, committed.size());
+    for (size_t i = 0; i < n; ++i) {
+        MY_REQUIRE_EQUAL(i, committed[i], "i = " << i);
+    }
+}
@@ -0,0 +1,95 @@
+#define BOOST_TEST_MODULE on_demand_index
+
+#include "test_generic_sequence.hpp"
+
+#include "on_demand_index.hpp"
+#include "block_codecs.hpp"
+#include "partitioned_sequence.hpp"
+#include "positive_sequence.hpp"
+#include <succinct/mapper.hpp>
+
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <numeric>
+
+template <typename Collection>
+void test_on_demand_index()
+{
+    using namespace quasi_succinct;
+
+    global_parameters params;
+    uint64_t universe = 20000;
+    typename Collection::builder b(universe, params);
+
+    typedef std::vector<uint64_t> vec_type;
+    std::vector<std::pair<vec_type, vec_type>> posting_lists(50);
+    for (auto& plist: posting_lists) {
+        double avg_gap = 1.1 + double(rand()) / RAND_MAX * 100;
+        uint64_t n = uint64_t(universe / avg_gap);
+        plist.first = random_sequence(universe, n, true);
+        plist.second.resize(n);
+        std::generate(plist.second.begin(), plist.second.end(),
+                      []() { return (rand() % 256) + 1; });
+        uint64_t freqs_sum = std::accumulate(plist.second.begin(),
+                                             plist.second.end(), uint64_t(0));
+        b.add_posting_list(n, plist.first.begin(),
+                           plist.second.begin(), freqs_sum);
+    }
+
+    {
+        Collection coll;
+        b.build(coll);
+        succinct::mapper::freeze(coll, "temp.bin");
+    }
+
+    for (bool use_io_uring: {true, false}) {
+        // a cache that holds only a few lists, so that they are evicted
+        // while their enumerators are still in use
+        on_demand_index<Collection> coll("temp.bin", 16384, use_io_uring);
+        BOOST_REQUIRE_EQUAL(posting_lists.size(), coll.size());
+        BOOST_REQUIRE_EQUAL(universe, coll.num_docs());
+
+        std::vector<typename on_demand_index<Collection>::document_enumerator> enums;
+        for (size_t round = 0; round < 2; ++round) {
+            for (size_t i = 0; i < posting_lists.size(); ++i) {
+                enums.push_back(coll[i]);
+            }
+        }
+        for (size_t i = 0; i < enums.size(); ++i) {
+            auto const& plist = posting_lists[i % posting_lists.size()];
+            auto& e = enums[i];
+            MY_REQUIRE_EQUAL(plist.first.size(), e.size(), "i = " << i);
+            for (size_t p = 0; p < plist.first.size(); ++p, e.next()) {
+                MY_REQUIRE_EQUAL(plist.first[p], e.docid(),
+                                 "i = " << i << " p = " << p);
+                MY_REQUIRE_EQUAL(plist.second[p], e.freq(),
+                                 "i = " << i << " p = " << p);
+            }
+            BOOST_REQUIRE_EQUAL(universe, e.docid());
+        }
+        BOOST_REQUIRE_GT(coll.misses(), posting_lists.size());
+
+        test_lookup_batch(coll, posting_lists);
+
+        // with a cache large enough for all the lists, the second round
+        // only has hits
+        on_demand_index<Collection> large("temp.bin", 1 << 30, use_io_uring);
+        for (size_t round = 0; round < 2; ++round) {
+            for (size_t i = 0; i < posting_lists.size(); ++i) {
+                large[i];
+            }
+        }
+        BOOST_REQUIRE_EQUAL(posting_lists.size(), large.misses());
+        BOOST_REQUIRE_EQUAL(posting_lists.size(), large.hits());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(on_demand_loading)
+{
+    using namespace quasi_succinct;
+    test_on_demand_index<freq_index<partitioned_sequence<>,
+                                    positive_sequence<partitioned_sequence<strict_sequence>>>>();
+    test_on_demand_index<block_freq_index<optpfor_block>>();
+    test_on_demand_index<block_freq_index<varint_G8IU_block>>();
+}
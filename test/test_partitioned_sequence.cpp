@@ -60,7 +60,9 @@ void test_partitioned_sequence(uint64_t universe,
 
 BOOST_AUTO_TEST_CASE(partitioned_sequence)
 {
+    quasi_succinct::global_parameters params;
     using quasi_succinct::indexed_sequence;
+    using quasi_succinct::bitpacked_indexed_sequence;
     using quasi_succinct::strict_sequence;
 
     if (boost::unit_test::framework::master_test_suite().argc == 2) {
@@ -87,6 +89,7 @@ BOOST_AUTO_TEST_CASE(partitioned_sequence)
         seq[0] = 1;
         test_partitioned_sequence<indexed_sequence>(2, seq);
         test_partitioned_sequence<strict_sequence>(2, seq);
+        test_partitioned_sequence<bitpacked_indexed_sequence>(2, seq);
     }
 
     std::vector<double> avg_gaps = { 1.1, 1.9, 2.5, 3, 4, 5, 10 };
@@ -96,6 +99,28 @@ BOOST_AUTO_TEST_CASE(partitioned_sequence)
         auto seq = random_sequence(universe, n, true);
         test_partitioned_sequence<indexed_sequence>(universe, seq);
         test_partitioned_sequence<strict_sequence>(universe, seq);
+        test_decode_range(quasi_succinct::partitioned_sequence<indexed_sequence>(),
+                          params, universe, seq);
+        test_partitioned_sequence<bitpacked_indexed_sequence>(universe, seq);
+        test_decode_range(quasi_succinct::partitioned_sequence<bitpacked_indexed_sequence>(),
+                          params, universe, seq);
+    }
+
+    // dense regions with irregular gaps, which are bit packed
+    {
+        std::vector<uint64_t> seq;
+        uint64_t value = 0;
+        for (size_t region = 0; region < 20; ++region) {
+            uint64_t max_gap = (region % 2) ? 4 : 1000;
+            for (size_t i = 0; i < 1000; ++i) {
+                value += 1 + rand() % max_gap;
+                seq.push_back(value);
+            }
+        }
+        uint64_t universe = value + 1;
+        test_partitioned_sequence<bitpacked_indexed_sequence>(universe, seq);
+        test_decode_range(quasi_succinct::partitioned_sequence<bitpacked_indexed_sequence>(),
+                          params, universe, seq);
     }
 
     // test also short (singleton partition) sequences with large universe
@@ -109,3 +134,48 @@ BOOST_AUTO_TEST_CASE(partitioned_sequence)
     }
 
 }
+
+BOOST_AUTO_TEST_CASE(optimal_partition_chunked)
+{
+    using quasi_succinct::optimal_partition;
+    quasi_succinct::global_parameters params;
+    auto const& conf = quasi_succinct::configuration::get();
+
+    auto cost_fun = [&](uint64_t universe, uint64_t n) {
+        return quasi_succinct::indexed_sequence::bitsize(params, universe, n) + conf.fix_cost;
+    };
+
+    // alternate dense and sparse regions, so that the optimal partitions
+    // have very different lengths
+    std::vector<uint64_t> seq;
+    uint64_t value = 0;
+    for (size_t region = 0; region < 40; ++region) {
+        uint64_t max_gap = (region % 3 == 0) ? 1 : (region % 3 == 1) ? 4 : 100;
+        for (size_t i = 0; i < 2500; ++i) {
+            value += 1 + rand() % max_gap;
+            seq.push_back(value);
+        }
+    }
+    uint64_t universe = value + 1;
+
+    optimal_partition serial(seq.begin(), universe, seq.size(), cost_fun,
+                             conf.eps1, conf.eps2);
+
+    for (uint64_t chunk_size: {997, 8000, 30000}) {
+        optimal_partition chunked(seq.begin(), universe, seq.size(), cost_fun,
+                                  conf.eps1, conf.eps2, chunk_size, 4);
+
+        BOOST_REQUIRE_EQUAL(seq.size(), chunked.partition.back());
+        uint64_t cur_begin = 0, cur_base = seq[0];
+        quasi_succinct::cost_t cost = 0;
+        for (auto end: chunked.partition) {
+            BOOST_REQUIRE_LT(cur_begin, end);
+            cost += cost_fun(seq[end - 1] - cur_base + 1, end - cur_begin);
+            cur_begin = end;
+            cur_base = seq[end - 1] + 1;
+        }
+        BOOST_REQUIRE_EQUAL(cost, chunked.cost_opt);
+
+        BOOST_REQUIRE_LE(chunked.cost_opt, serial.cost_opt + chunked.boundary_cost);
+    }
+}
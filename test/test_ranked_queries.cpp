@@ -48,7 +48,7 @@ namespace quasi_succinct { namespace test {
                 op_q(index, q);
                 BOOST_REQUIRE_EQUAL(or_q.topk().size(), op_q.topk().size());
                 for (size_t i = 0; i < or_q.topk().size(); ++i) {
-                    BOOST_REQUIRE_CLOSE(or_q.topk()[i], op_q.topk()[i], 0.1); // tolerance is % relative
+                    BOOST_REQUIRE_CLOSE(or_q.topk()[i].first, op_q.topk()[i].first, 0.1); // tolerance is % relative
                 }
             }
         }
@@ -66,9 +66,30 @@ BOOST_FIXTURE_TEST_CASE(wand,
     test_against_or(wand_q);
 }
 
+BOOST_FIXTURE_TEST_CASE(block_max_wand,
+                        quasi_succinct::test::index_initialization)
+{
+    quasi_succinct::block_max_wand_query block_max_wand_q(wdata, 10);
+    test_against_or(block_max_wand_q);
+}
+
 BOOST_FIXTURE_TEST_CASE(maxscore,
                         quasi_succinct::test::index_initialization)
 {
     quasi_succinct::maxscore_query maxscore_q(wdata, 10);
     test_against_or(maxscore_q);
 }
+
+BOOST_FIXTURE_TEST_CASE(parallel_ranked_or,
+                        quasi_succinct::test::index_initialization)
+{
+    quasi_succinct::parallel_ranked_or_query parallel_or_q(wdata, 10, 4);
+    test_against_or(parallel_or_q);
+}
+
+BOOST_FIXTURE_TEST_CASE(parallel_maxscore,
+                        quasi_succinct::test::index_initialization)
+{
+    quasi_succinct::parallel_maxscore_query parallel_maxscore_q(wdata, 10, 4);
+    test_against_or(parallel_maxscore_q);
+}
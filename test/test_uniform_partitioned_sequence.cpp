@@ -36,5 +36,7 @@ BOOST_AUTO_TEST_CASE(uniform_partitioned_sequence)
                       params, universe, seq);
         test_sequence(quasi_succinct::uniform_partitioned_sequence<strict_sequence>(),
                       params, universe, seq);
+        test_decode_range(quasi_succinct::uniform_partitioned_sequence<indexed_sequence>(),
+                          params, universe, seq);
     }
 }
@@ -210,6 +210,31 @@ namespace quasi_succinct {
                 }
             }
 
+            // note: this is instantiated only if BaseSequence has decode_range
+            void decode_range(uint64_t position, uint64_t count, uint32_t* out)
+            {
+                assert(count > 0 && position + count <= size());
+                move(position);
+
+                while (true) {
+                    uint64_t partition_count = std::min(count, m_cur_end - m_position);
+                    m_partition_enum.decode_range(m_position - m_cur_begin,
+                                                  partition_count, out);
+                    uint32_t base = uint32_t(m_cur_base);
+                    for (uint64_t i = 0; i < partition_count; ++i) {
+                        out[i] += base;
+                    }
+                    // leave the enumerator on the last decoded value
+                    m_position += partition_count - 1;
+                    count -= partition_count;
+                    out += partition_count;
+                    if (!count) break;
+
+                    m_position += 1;
+                    switch_partition(m_cur_partition + 1);
+                }
+            }
+
         private:
 
             // the compiler does not seem smart enough to figure out that this
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
 #include <cmath>
+#include <utility>
 #include <vector>
 #include <iomanip>
 #include <locale>
@@ -140,6 +142,62 @@ namespace quasi_succinct {
         return function_iterator<State, AdvanceFunctor, ValueFunctor>(initial_state);
     }
 
+    // Term ids passed to the lookup_batch of the indexes can also be pairs
+    // whose first element is the term id, such as the query term
+    // frequencies
+    inline uint64_t batch_term_id(uint64_t term)
+    {
+        return term;
+    }
+
+    template <typename T, typename U>
+    inline uint64_t batch_term_id(std::pair<T, U> const& term)
+    {
+        return term.first;
+    }
+
+    // Helper for lookup_batch: splits the terms in [begin, end) in batches
+    // of at most max_lookup_batch, and for each batch calls resolve(i, term)
+    // in increasing term order, then build(i, term) in input order, where i
+    // is the index of the term in the batch. The state for each term can
+    // thus be kept in arrays of max_lookup_batch elements on the stack.
+    static const size_t max_lookup_batch = 32;
+
+    template <typename TermIterator, typename Resolve, typename Build>
+    void for_each_lookup_batch(TermIterator begin, TermIterator end,
+                               Resolve resolve, Build build)
+    {
+        std::pair<uint64_t, uint32_t> sorted[max_lookup_batch];
+        while (begin != end) {
+            size_t n = 0;
+            bool is_sorted = true;
+            for (; begin != end && n < max_lookup_batch; ++begin, ++n) {
+                sorted[n] = std::make_pair(batch_term_id(*begin), uint32_t(n));
+                is_sorted &= !n || sorted[n - 1].first <= sorted[n].first;
+            }
+            if (!is_sorted) {
+                std::sort(sorted, sorted + n);
+            }
+
+            for (size_t k = 0; k < n; ++k) {
+                resolve(sorted[k].second, sorted[k].first);
+            }
+            if (is_sorted) {
+                for (size_t i = 0; i < n; ++i) {
+                    build(i, sorted[i].first);
+                }
+            } else {
+                uint64_t terms[max_lookup_batch];
+                for (size_t k = 0; k < n; ++k) {
+                    terms[sorted[k].second] = sorted[k].first;
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    build(i, terms[i]);
+                }
+            }
+        }
+    }
+
 
     struct stats_line {
         stats_line()
@@ -4,6 +4,7 @@
 
 #include "binary_freq_collection.hpp"
 #include "bm25.hpp"
+#include "configuration.hpp"
 #include "util.hpp"
 
 namespace quasi_succinct {
@@ -12,12 +13,15 @@ namespace quasi_succinct {
     class wand_data {
     public:
         wand_data()
+            : m_num_docs(0)
         {}
 
         template <typename LengthsIterator>
         wand_data(LengthsIterator len_it, uint64_t num_docs,
                   binary_freq_collection const& coll)
         {
+            auto const& conf = configuration::get();
+
             std::vector<float> norm_lens(num_docs);
             double lens_sum = 0;
             logger() << "Reading sizes..." << std::endl;
@@ -31,25 +35,54 @@ namespace quasi_succinct {
                 norm_lens[i] /= avg_len;
             }
 
-            logger() << "Storing max weight for each list..." << std::endl;
+            if (conf.wand_block_lambda > 0) {
+                logger() << "Using variable blocks with lambda "
+                         << conf.wand_block_lambda << std::endl;
+            } else {
+                logger() << "Using fixed blocks of size "
+                         << conf.wand_block_size << std::endl;
+            }
+
+            logger() << "Storing max weight for each list and block..." << std::endl;
             std::vector<float> max_term_weight;
+            std::vector<uint64_t> blocks_begin(1, 0);
+            std::vector<uint32_t> block_docids;
+            std::vector<float> block_max_weights;
+            std::vector<float> scores;
             for (auto const& seq: coll) {
+                scores.resize(seq.docs.size());
                 float max_score = 0;
                 for (size_t i = 0; i < seq.docs.size(); ++i) {
                     uint64_t docid = *(seq.docs.begin() + i);
                     uint64_t freq = *(seq.freqs.begin() + i);
                     float score = Scorer::doc_term_weight(freq, norm_lens[docid]);
+                    scores[i] = score;
                     max_score = std::max(max_score, score);
                 }
                 max_term_weight.push_back(max_score);
+
+                if (conf.wand_block_lambda > 0) {
+                    variable_blocks(seq.docs.begin(), scores, conf.wand_block_lambda,
+                                    block_docids, block_max_weights);
+                } else {
+                    fixed_blocks(seq.docs.begin(), scores, conf.wand_block_size,
+                                 block_docids, block_max_weights);
+                }
+                blocks_begin.push_back(block_docids.size());
+
                 if ((max_term_weight.size() % 1000000) == 0) {
                     logger() << max_term_weight.size() << " list processed" << std::endl;
                 }
             }
             logger() << max_term_weight.size() << " list processed" << std::endl;
+            logger() << block_docids.size() << " blocks stored" << std::endl;
 
+            m_num_docs = num_docs;
             m_norm_lens.steal(norm_lens);
             m_max_term_weight.steal(max_term_weight);
+            m_blocks_begin.steal(blocks_begin);
+            m_block_docids.steal(block_docids);
+            m_block_max_weights.steal(block_max_weights);
         }
 
         float norm_len(uint64_t doc_id) const
@@ -62,24 +95,142 @@ namespace quasi_succinct {
             return m_max_term_weight[term_id];
         }
 
+        // Enumerates the blocks of a posting list. Each block covers the
+        // docids up to (and including) docid(), starting after the end of
+        // the previous block, and score() is the maximum doc_term_weight of
+        // the postings it contains. Once past the last block, docid() is
+        // the number of documents and score() is 0.
+        class block_enumerator {
+        public:
+            block_enumerator(uint32_t const* docids, float const* weights,
+                             uint64_t n, uint64_t num_docs)
+                : m_docids(docids)
+                , m_weights(weights)
+                , m_n(n)
+                , m_num_docs(num_docs)
+                , m_cur(0)
+            {}
+
+            void QS_ALWAYSINLINE next_geq(uint64_t lower_bound)
+            {
+                while (m_cur < m_n && m_docids[m_cur] < lower_bound) {
+                    ++m_cur;
+                }
+            }
+
+            uint64_t docid() const
+            {
+                return QS_LIKELY(m_cur < m_n) ? m_docids[m_cur] : m_num_docs;
+            }
+
+            float score() const
+            {
+                return QS_LIKELY(m_cur < m_n) ? m_weights[m_cur] : 0;
+            }
+
+            uint64_t size() const
+            {
+                return m_n;
+            }
+
+        private:
+            uint32_t const* m_docids;
+            float const* m_weights;
+            uint64_t m_n;
+            uint64_t m_num_docs;
+            uint64_t m_cur;
+        };
+
+        block_enumerator block_max(uint64_t term_id) const
+        {
+            uint64_t begin = m_blocks_begin[term_id];
+            uint64_t end = m_blocks_begin[term_id + 1];
+            return block_enumerator(m_block_docids.data() + begin,
+                                    m_block_max_weights.data() + begin,
+                                    end - begin, m_num_docs);
+        }
+
         void swap(wand_data& other)
         {
+            std::swap(m_num_docs, other.m_num_docs);
             m_norm_lens.swap(other.m_norm_lens);
             m_max_term_weight.swap(other.m_max_term_weight);
+            m_blocks_begin.swap(other.m_blocks_begin);
+            m_block_docids.swap(other.m_block_docids);
+            m_block_max_weights.swap(other.m_block_max_weights);
         }
 
         template <typename Visitor>
         void map(Visitor& visit)
         {
             visit
+                (m_num_docs, "m_num_docs")
                 (m_norm_lens, "m_norm_lens")
                 (m_max_term_weight, "m_max_term_weight")
+                (m_blocks_begin, "m_blocks_begin")
+                (m_block_docids, "m_block_docids")
+                (m_block_max_weights, "m_block_max_weights")
                 ;
         }
 
     private:
+
+        template <typename DocsIterator>
+        static void fixed_blocks(DocsIterator docs_begin,
+                                 std::vector<float> const& scores,
+                                 uint64_t block_size,
+                                 std::vector<uint32_t>& block_docids,
+                                 std::vector<float>& block_max_weights)
+        {
+            assert(block_size > 0);
+            for (size_t b = 0; b < scores.size(); b += block_size) {
+                size_t e = std::min(scores.size(), b + block_size);
+                block_docids.push_back(*(docs_begin + (e - 1)));
+                block_max_weights.push_back(*std::max_element(scores.begin() + b,
+                                                              scores.begin() + e));
+            }
+        }
+
+        // Greedy variable-size partition: a block is closed as soon as the
+        // total gap between its maximum and the scores of its postings
+        // would exceed lambda, so blocks are long where the scores are
+        // flat and short where they vary.
+        template <typename DocsIterator>
+        static void variable_blocks(DocsIterator docs_begin,
+                                    std::vector<float> const& scores,
+                                    float lambda,
+                                    std::vector<uint32_t>& block_docids,
+                                    std::vector<float>& block_max_weights)
+        {
+            float cur_max = 0;
+            double cur_sum = 0;
+            size_t cur_size = 0;
+            for (size_t i = 0; i < scores.size(); ++i) {
+                float new_max = std::max(cur_max, scores[i]);
+                double slack = double(new_max) * (cur_size + 1) - (cur_sum + scores[i]);
+                if (cur_size && slack > lambda) {
+                    block_docids.push_back(*(docs_begin + (i - 1)));
+                    block_max_weights.push_back(cur_max);
+                    new_max = scores[i];
+                    cur_sum = 0;
+                    cur_size = 0;
+                }
+                cur_max = new_max;
+                cur_sum += scores[i];
+                cur_size += 1;
+            }
+            if (cur_size) {
+                block_docids.push_back(*(docs_begin + (scores.size() - 1)));
+                block_max_weights.push_back(cur_max);
+            }
+        }
+
+        uint64_t m_num_docs;
         succinct::mapper::mappable_vector<float> m_norm_lens;
         succinct::mapper::mappable_vector<float> m_max_term_weight;
+        succinct::mapper::mappable_vector<uint64_t> m_blocks_begin;
+        succinct::mapper::mappable_vector<uint32_t> m_block_docids;
+        succinct::mapper::mappable_vector<float> m_block_max_weights;
     };
 
 }